@@ -0,0 +1,560 @@
+/* Filename: joblimits.c
+ * Author: Howard Chen
+ * Description: Implements the "limit" and "timeout" command prefixes.
+ *
+ * 	limit [-v KiB] [-t seconds] [-n files] [-u processes] command ...
+ * 	timeout seconds command ...
+ *
+ * 	The flags match the ones used by ulimit. Resource limits are set with
+ * 	setrlimit() in the child. Timeouts are enforced by the shell: every timed
+ * 	job gets a pidfd, and a single timerfd is armed for the earliest deadline.
+ * 	When a deadline passes the job is sent SIGTERM, and if it is still alive
+ * 	KILL_GRACE_MS later it is sent SIGKILL. A timed job always starts with the
+ * 	default SIGTERM action, even in the foreground, so it can shut down cleanly.
+ * 	A job that has already exited is never signalled. Each enforcement is
+ * 	notified when it happens, and recorded for the status builtin to list.
+ *
+ * 	Deadlines are enforced while the shell waits for a foreground job and while
+ * 	it waits for input, whether the input is a terminal, a pipe or a file.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/resource.h>
+#include <sys/timerfd.h>
+#include <sys/wait.h>
+
+#include "joblimits.h"
+#include "notify.h"
+
+#define KILL_GRACE_MS 2000 /*Time between SIGTERM and SIGKILL, same as kill_everything() */
+#define MAX_RECORDS 16     /*Number of enforcement records kept for status */
+#define NO_DEADLINE -1
+
+struct watched {
+	pid_t pid;
+	int pidfd;           /*-1 if pidfds are not supported */
+	long long deadline;  /*Monotonic time in nanoseconds, or NO_DEADLINE */
+	long timeout_ms;     /*Timeout the job was started with */
+	int stage;           /*0: running, 1: sent SIGTERM, 2: sent SIGKILL */
+	int cpu_limited;     /*1 if the job was started with limit -t */
+};
+
+struct record {
+	pid_t pid;
+	long timeout_ms; /*-1 for a CPU limit record */
+	int signo;       /*Signal that was sent, or that the job died from */
+};
+
+static struct watched* jobs = NULL;
+static int num_jobs = 0;
+static int max_jobs = 0;
+static int timer_fd = -1;
+
+static struct record records[MAX_RECORDS];
+static int num_records = 0; /*Total records ever made, so the ring index is num_records % MAX_RECORDS */
+
+
+/*Returns the current monotonic time in nanoseconds */
+static long long now_ns() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/*The libc wrappers for pidfds are newer than the kernel calls, so use syscall() */
+static int open_pidfd(pid_t pid) {
+#ifdef SYS_pidfd_open
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*Returns 1 if the job has exited but has not been reaped yet, 0 otherwise.
+ * WNOWAIT leaves it for cleanup() or joblimits_wait() to reap */
+static int has_exited(struct watched* job) {
+	siginfo_t info;
+
+	memset(&info, 0, sizeof(info));
+	if(waitid(P_PID, job->pid, &info, WEXITED | WNOHANG | WNOWAIT) != 0) {
+		return 0;
+	}
+	return info.si_pid == job->pid;
+}
+
+/*Sends signo to the job, through its pidfd if it has one so a recycled pid is never hit */
+static void send_signal(struct watched* job, int signo) {
+#ifdef SYS_pidfd_send_signal
+	if(job->pidfd >= 0 && syscall(SYS_pidfd_send_signal, job->pidfd, signo, NULL, 0) == 0) {
+		return;
+	}
+#endif
+	kill(job->pid, signo);
+}
+
+/*Adds an enforcement record, overwriting the oldest one if the ring is full */
+static void add_record(pid_t pid, long timeout_ms, int signo) {
+	struct record* r = &records[num_records % MAX_RECORDS];
+
+	r->pid = pid;
+	r->timeout_ms = timeout_ms;
+	r->signo = signo;
+	num_records++;
+}
+
+/*Arms the timerfd for the earliest deadline, or disarms it if there is none */
+static void arm_timer() {
+	struct itimerspec its;
+	long long earliest = NO_DEADLINE;
+	int i;
+
+	if(timer_fd < 0) {
+		return;
+	}
+
+	for(i = 0; i < num_jobs; i++) {
+		if(jobs[i].deadline != NO_DEADLINE && (earliest == NO_DEADLINE || jobs[i].deadline < earliest)) {
+			earliest = jobs[i].deadline;
+		}
+	}
+
+	memset(&its, 0, sizeof(its));
+	if(earliest != NO_DEADLINE) {
+		its.it_value.tv_sec = earliest / 1000000000LL;
+		its.it_value.tv_nsec = earliest % 1000000000LL;
+		/*An all zero value disarms the timer, so never arm for exactly zero */
+		if(its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+			its.it_value.tv_nsec = 1;
+		}
+	}
+	timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+/*Returns 1 if a deadline is pending, so the caller needs to watch the timerfd */
+static int has_deadline() {
+	int i;
+
+	for(i = 0; i < num_jobs; i++) {
+		if(jobs[i].deadline != NO_DEADLINE) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*Returns the watched job with the given pid, or NULL */
+static struct watched* find(pid_t pid) {
+	int i;
+
+	for(i = 0; i < num_jobs; i++) {
+		if(jobs[i].pid == pid) {
+			return &jobs[i];
+		}
+	}
+	return NULL;
+}
+
+/*Parses a non-negative whole number. Returns -1 if text is not one */
+static long parse_count(const char* text) {
+	char* end;
+	long value;
+
+	if(text == NULL) {
+		return -1;
+	}
+	errno = 0;
+	value = strtol(text, &end, 10);
+	if(errno != 0 || end == text || *end != '\0' || value < 0) {
+		return -1;
+	}
+	return value;
+}
+
+/*Parses a number of seconds, which may have a fraction, into milliseconds.
+ * Returns -1 if text is not a positive duration */
+static long parse_duration(const char* text) {
+	char* end;
+	double seconds;
+
+	if(text == NULL) {
+		return -1;
+	}
+	errno = 0;
+	seconds = strtod(text, &end);
+	if(errno != 0 || end == text || *end != '\0' || !(seconds > 0) || seconds > 1e9) {
+		return -1;
+	}
+	return (long) (seconds * 1000 + 0.5);
+}
+
+/*Sets both the soft and hard value of a resource limit */
+static int set_limit(int resource, rlim_t soft, rlim_t hard) {
+	struct rlimit rl;
+
+	rl.rlim_cur = soft;
+	rl.rlim_max = hard;
+	return setrlimit(resource, &rl);
+}
+
+/*Marks every limit as unset */
+void joblimits_clear(struct job_limits* lim) {
+	lim->as_kb = -1;
+	lim->cpu_sec = -1;
+	lim->nofile = -1;
+	lim->nproc = -1;
+	lim->timeout_ms = -1;
+}
+
+/* Description: parses any leading "limit" and "timeout" prefixes
+ * args: [1] params: array of char* parameters
+ * 	[2] argc: number of parameters
+ * 	[3] lim: filled in with the parsed limits
+ * pre: lim has been cleared with joblimits_clear()
+ * post: lim holds every limit given by the prefixes. Prefixes can be repeated
+ * 	and combined, and a later value replaces an earlier one
+ * ret: the number of parameters used by the prefixes, or -1 after printing an
+ * 	error if a prefix is malformed or no command follows it
+ */
+int joblimits_parse(char* params[], int argc, struct job_limits* lim) {
+	int current = 0;
+	long value;
+	long* target;
+
+	while(current < argc) {
+		if(strcmp(params[current], "timeout") == 0) {
+			value = parse_duration(current + 1 < argc ? params[current + 1] : NULL);
+			if(value < 0) {
+				fprintf(stderr, "timeout: usage: timeout seconds command ...\n"); fflush(stderr);
+				return -1;
+			}
+			lim->timeout_ms = value;
+			current += 2;
+
+		} else if(strcmp(params[current], "limit") == 0) {
+			current++;
+			/*Each flag takes a value, and the flags end at the first non-flag */
+			while(current < argc && params[current][0] == '-') {
+				if(strcmp(params[current], "-v") == 0) {
+					target = &lim->as_kb;
+				} else if(strcmp(params[current], "-t") == 0) {
+					target = &lim->cpu_sec;
+				} else if(strcmp(params[current], "-n") == 0) {
+					target = &lim->nofile;
+				} else if(strcmp(params[current], "-u") == 0) {
+					target = &lim->nproc;
+				} else {
+					target = NULL;
+				}
+
+				value = parse_count(current + 1 < argc ? params[current + 1] : NULL);
+				if(target == NULL || value < 0) {
+					fprintf(stderr, "limit: usage: limit [-v KiB] [-t seconds] [-n files] "
+						"[-u processes] command ...\n");
+					fflush(stderr);
+					return -1;
+				}
+				*target = value;
+				current += 2;
+			}
+
+		} else {
+			break;
+		}
+	}
+
+	/*A prefix needs a command to apply to. "&" on its own is not a command */
+	if(current > 0 && (current == argc || strcmp(params[current], "&") == 0)) {
+		fprintf(stderr, "%s: missing command\n", params[0]); fflush(stderr);
+		return -1;
+	}
+	return current;
+}
+
+/* Description: applies the resource limits to the calling process
+ * args: lim: limits to apply
+ * pre: CALL THIS FUNCTION WITHIN THE CHILD PROCESS, before execvp()
+ * post: every set limit is applied with setrlimit(). The CPU limit gets a hard
+ * 	limit one second above the soft one, so the job sees SIGXCPU before SIGKILL.
+ * 	A job with a timeout gets the default SIGTERM action back, since foreground
+ * 	children ignore SIGTERM and that would survive execvp()
+ * ret: 0 on success, -1 if any limit could not be set
+ */
+int joblimits_apply(const struct job_limits* lim) {
+	struct sigaction SIGTERM_action = {{0}};
+	int result = 0;
+
+	if(lim->timeout_ms >= 0) {
+		SIGTERM_action.sa_handler = SIG_DFL;
+		sigfillset(&SIGTERM_action.sa_mask);
+		SIGTERM_action.sa_flags = 0;
+		sigaction(SIGTERM, &SIGTERM_action, NULL);
+	}
+
+	if(lim->as_kb >= 0) {
+		result |= set_limit(RLIMIT_AS, (rlim_t) lim->as_kb * 1024, (rlim_t) lim->as_kb * 1024);
+	}
+	if(lim->cpu_sec >= 0) {
+		result |= set_limit(RLIMIT_CPU, lim->cpu_sec, lim->cpu_sec + 1);
+	}
+	if(lim->nofile >= 0) {
+		result |= set_limit(RLIMIT_NOFILE, lim->nofile, lim->nofile);
+	}
+	if(lim->nproc >= 0) {
+		result |= set_limit(RLIMIT_NPROC, lim->nproc, lim->nproc);
+	}
+	return result == 0 ? 0 : -1;
+}
+
+/* Description: starts watching a child process that was started with limits
+ * args: [1] pid: the child process
+ * 	[2] lim: the limits it was started with
+ * pre: CALL THIS FUNCTION IN THE PARENT, before the child can be reaped
+ * post: if the job has a timeout, its deadline is armed on the timerfd
+ * ret: none
+ */
+void joblimits_watch(pid_t pid, const struct job_limits* lim) {
+	struct watched* job;
+
+	if(lim->timeout_ms < 0 && lim->cpu_sec < 0) {
+		return;
+	}
+
+	if(num_jobs == max_jobs) {
+		max_jobs = max_jobs == 0 ? 8 : max_jobs * 2;
+		jobs = realloc(jobs, max_jobs * sizeof(struct watched));
+		if(jobs == NULL) {
+			perror("Failure to allocate job table"); fflush(stderr);
+			exit(1);
+		}
+	}
+
+	job = &jobs[num_jobs];
+	num_jobs++;
+
+	job->pid = pid;
+	job->pidfd = -1;
+	job->deadline = NO_DEADLINE;
+	job->timeout_ms = lim->timeout_ms;
+	job->stage = 0;
+	job->cpu_limited = lim->cpu_sec >= 0;
+
+	if(lim->timeout_ms >= 0) {
+		job->pidfd = open_pidfd(pid);
+		job->deadline = now_ns() + (long long) lim->timeout_ms * 1000000LL;
+
+		if(timer_fd < 0) {
+			timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+			if(timer_fd < 0) {
+				perror("Failure to create timeout timer"); fflush(stderr);
+			}
+		}
+		arm_timer();
+	}
+}
+
+/* Description: sends signals to every job whose deadline has passed
+ * args: none
+ * pre: none
+ * post: jobs past their timeout are sent SIGTERM, and jobs still alive
+ * 	KILL_GRACE_MS after that are sent SIGKILL. Each signal is notified and
+ * 	recorded. Jobs
+ * 	that have exited but are not reaped yet lose their deadline instead
+ * ret: none
+ */
+void joblimits_enforce() {
+	unsigned long long expirations;
+	long long now = now_ns();
+	int i;
+
+	if(num_jobs == 0) {
+		return;
+	}
+
+	/*Drain the timerfd so poll() does not keep reporting it */
+	if(timer_fd >= 0) {
+		while(read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+		}
+	}
+
+	for(i = 0; i < num_jobs; i++) {
+		if(jobs[i].deadline == NO_DEADLINE || jobs[i].deadline > now) {
+			continue;
+		}
+		/*A job that finished in time is just waiting to be reaped */
+		if(has_exited(&jobs[i]) == 1) {
+			jobs[i].deadline = NO_DEADLINE;
+			continue;
+		}
+		if(jobs[i].stage == 0) {
+			send_signal(&jobs[i], SIGTERM);
+			add_record(jobs[i].pid, jobs[i].timeout_ms, SIGTERM);
+			notify_timeout(jobs[i].pid, jobs[i].timeout_ms, SIGTERM);
+			jobs[i].stage = 1;
+			jobs[i].deadline = now + KILL_GRACE_MS * 1000000LL;
+		} else {
+			send_signal(&jobs[i], SIGKILL);
+			add_record(jobs[i].pid, jobs[i].timeout_ms, SIGKILL);
+			notify_timeout(jobs[i].pid, jobs[i].timeout_ms, SIGKILL);
+			jobs[i].stage = 2;
+			jobs[i].deadline = NO_DEADLINE;
+		}
+	}
+
+	arm_timer();
+}
+
+/* Description: waits for a foreground child, enforcing deadlines meanwhile
+ * args: [1] pid: the child process to wait for
+ * 	[2] childExitMethod: set to the status returned by waitpid()
+ * pre: pid is a child of the shell that has not been reaped
+ * post: the child has been reaped. While waiting, any timed job (foreground or
+ * 	background) that passes its deadline is signalled
+ * ret: none
+ */
+void joblimits_wait(pid_t pid, int* childExitMethod) {
+	struct pollfd fds[2];
+	struct watched* job;
+	int pidfd = -1;
+	int own = 0;
+
+	if(timer_fd < 0 || has_deadline() == 0) {
+		while( waitpid(pid, childExitMethod, 0) != pid) {
+			/*Keep waiting until it's over */
+		}
+		return;
+	}
+
+	job = find(pid);
+	if(job != NULL && job->pidfd >= 0) {
+		pidfd = job->pidfd;
+	} else {
+		pidfd = open_pidfd(pid);
+		own = 1;
+	}
+
+	while(waitpid(pid, childExitMethod, WNOHANG) != pid) {
+		fds[0].fd = timer_fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = pidfd;
+		fds[1].events = POLLIN;
+
+		/*Without a pidfd, wake up regularly to check on the child */
+		if(poll(fds, pidfd >= 0 ? 2 : 1, pidfd >= 0 ? -1 : 50) > 0 && (fds[0].revents & POLLIN)) {
+			joblimits_enforce();
+		}
+	}
+
+	if(own == 1 && pidfd >= 0) {
+		close(pidfd);
+	}
+}
+
+/* Description: blocks until fd has input, enforcing deadlines meanwhile
+ * args: fd: the file descriptor the shell reads commands from
+ * pre: the caller has no whole line from fd buffered, so it really needs to read
+ * post: fd is readable, or this returns right away if no deadline is pending
+ * ret: none
+ */
+void joblimits_wait_input(int fd) {
+	struct pollfd fds[2];
+
+	if(timer_fd < 0) {
+		return;
+	}
+
+	while(has_deadline() == 1) {
+		fds[0].fd = fd;
+		fds[0].events = POLLIN;
+		fds[1].fd = timer_fd;
+		fds[1].events = POLLIN;
+
+		if(poll(fds, 2, -1) < 0) {
+			/*Interrupted by a signal, such as SIGCHLD. Keep waiting */
+			continue;
+		}
+		if(fds[1].revents & POLLIN) {
+			joblimits_enforce();
+		}
+		if(fds[0].revents != 0) {
+			return;
+		}
+	}
+}
+
+/* Description: forgets a child process after it has been reaped
+ * args: [1] pid: the reaped child
+ * 	[2] childExitMethod: its status from waitpid()
+ * pre: none
+ * post: the job's pidfd is closed and its deadline is removed. A job with a CPU
+ * 	limit that died from SIGXCPU is notified and recorded
+ * ret: none
+ */
+void joblimits_reaped(pid_t pid, int childExitMethod) {
+	struct watched* job = find(pid);
+
+	if(job == NULL) {
+		return;
+	}
+
+	if(job->cpu_limited == 1 && WIFSIGNALED(childExitMethod) && WTERMSIG(childExitMethod) == SIGXCPU) {
+		add_record(pid, -1, SIGXCPU);
+		notify_limit(pid, SIGXCPU);
+	}
+
+	if(job->pidfd >= 0) {
+		close(job->pidfd);
+	}
+
+	/*Move the last job into this slot */
+	num_jobs--;
+	*job = jobs[num_jobs];
+	arm_timer();
+}
+
+/*Queues the most recent enforcement records as lines of the status builtin's
+ * output, oldest first */
+void joblimits_print() {
+	struct record* r;
+	int first = num_records > MAX_RECORDS ? num_records - MAX_RECORDS : 0;
+	int i;
+
+	for(i = first; i < num_records; i++) {
+		r = &records[i % MAX_RECORDS];
+		if(r->signo == SIGXCPU) {
+			notify_status_limit(r->pid);
+		} else {
+			notify_status_timeout(r->pid, r->timeout_ms, r->signo);
+		}
+	}
+}
+
+/*Closes every pidfd and the timerfd, and forgets every job */
+void joblimits_free() {
+	int i;
+
+	for(i = 0; i < num_jobs; i++) {
+		if(jobs[i].pidfd >= 0) {
+			close(jobs[i].pidfd);
+		}
+	}
+	free(jobs);
+	jobs = NULL;
+	num_jobs = max_jobs = 0;
+
+	if(timer_fd >= 0) {
+		close(timer_fd);
+		timer_fd = -1;
+	}
+}
@@ -0,0 +1,34 @@
+/* Filename: joblimits.h
+ * Author: Howard Chen
+ * Description: Interface for per-job resource limits and wall clock timeouts.
+ * 	"limit" and "timeout" prefixes are parsed into a struct job_limits. The
+ * 	resource limits are applied in the child before execvp(), and the timeouts
+ * 	are enforced by the shell, which escalates from SIGTERM to SIGKILL.
+ */
+
+#ifndef JOBLIMITS_H
+#define JOBLIMITS_H
+
+#include <sys/types.h>
+
+struct job_limits {
+	long as_kb;      /*Address space limit in KiB (limit -v), -1 if unset */
+	long cpu_sec;    /*CPU time limit in seconds (limit -t), -1 if unset */
+	long nofile;     /*Open file limit (limit -n), -1 if unset */
+	long nproc;      /*Process limit (limit -u), -1 if unset */
+	long timeout_ms; /*Wall clock deadline in milliseconds (timeout), -1 if unset */
+};
+
+void joblimits_clear(struct job_limits* lim);
+int joblimits_parse(char* params[], int argc, struct job_limits* lim);
+int joblimits_apply(const struct job_limits* lim);
+
+void joblimits_watch(pid_t pid, const struct job_limits* lim);
+void joblimits_wait(pid_t pid, int* childExitMethod);
+void joblimits_wait_input(int fd);
+void joblimits_enforce();
+void joblimits_reaped(pid_t pid, int childExitMethod);
+void joblimits_print();
+void joblimits_free();
+
+#endif
@@ -0,0 +1,298 @@
+/* Filename: notify.c
+ * Author: Howard Chen
+ * Description: Implements the notification queue.
+ *
+ * 	Every job message is queued at the moment its event happens, in order.
+ * 	notify_flush() writes the queue and the prompt with a single writev(), so a
+ * 	cycle that reaps hundreds of background jobs costs one system call instead
+ * 	of one or more per job. The queue is always flushed before the prompt, so the
+ * 	messages still come out before anything the next command prints. Signal
+ * 	handlers write their messages directly, since they cannot use the queue.
+ *
+ * 	In JSON mode each job message is a JSON object on its own line instead, for
+ * 	log collectors. Every object has an "event" name and the "time" the event
+ * 	happened, in seconds since the epoch. The objects can go to their own file
+ * 	descriptor, leaving stdout to the prompt and the commands. When they share
+ * 	stdout, a batch that follows a prompt starts with a newline, so no object
+ * 	begins after ": ". The output of the status builtin is for the user, so it
+ * 	is always text on stdout.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+
+#include "notify.h"
+
+#define INITIAL_SIZE 4096
+
+struct queue {
+	char* data;
+	size_t used;
+	size_t size;
+};
+
+static struct queue out;    /*Everything for stdout */
+static struct queue events; /*JSON lines for json_fd, when that is not stdout */
+static int json = 0;
+static int json_fd = STDOUT_FILENO; /*Where JSON lines are written */
+static int after_prompt = 0;        /*1 if the last thing flushed to stdout was a prompt */
+
+
+/*Makes sure the queue can hold at least needed bytes */
+static void grow(struct queue* q, size_t needed) {
+	size_t new_size = q->size == 0 ? INITIAL_SIZE : q->size;
+
+	while(new_size < needed) {
+		new_size *= 2;
+	}
+	if(new_size == q->size) {
+		return;
+	}
+
+	q->data = realloc(q->data, new_size);
+	if(q->data == NULL) {
+		perror("Failure to allocate notification queue"); fflush(stderr);
+		exit(1);
+	}
+	q->size = new_size;
+}
+
+/*Appends formatted text to the queue */
+static void append(struct queue* q, const char* format, ...) {
+	va_list args;
+	int n;
+
+	grow(q, q->used + 1);
+	while(1) {
+		va_start(args, format);
+		n = vsnprintf(q->data + q->used, q->size - q->used, format, args);
+		va_end(args);
+
+		if(n < 0) {
+			return;
+		}
+		if((size_t) n < q->size - q->used) {
+			q->used += n;
+			return;
+		}
+
+		/*Not enough room, so grow the queue and format again */
+		grow(q, q->used + n + 1);
+	}
+}
+
+/*Returns the queue that job messages go to */
+static struct queue* event_queue() {
+	return (json && json_fd != STDOUT_FILENO) ? &events : &out;
+}
+
+/*Starts a JSON line with the event name and the current time */
+static void begin_json(struct queue* q, const char* event) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	append(q, "{\"event\":\"%s\",\"time\":%lld.%03ld", event, (long long) ts.tv_sec, ts.tv_nsec / 1000000);
+}
+
+/*Appends the text for a timeout signal, as used by events and by status */
+static void timeout_text(struct queue* q, pid_t pid, long timeout_ms, int signo) {
+	if(signo == SIGTERM) {
+		append(q, "timeout: pid %i ran past %ld ms, sent signal %i\n", pid, timeout_ms, signo);
+	} else {
+		append(q, "timeout: pid %i outlived SIGTERM, sent signal %i\n", pid, signo);
+	}
+}
+
+/*Turns JSON lines mode on (1) or off (0) */
+void notify_set_json(int on) {
+	json = on;
+}
+
+/*Sends JSON lines to fd instead of stdout. Text messages always go to stdout */
+void notify_set_fd(int fd) {
+	json_fd = fd;
+}
+
+/*Queues the message for a command started in the background */
+void notify_background(pid_t pid) {
+	struct queue* q = event_queue();
+
+	if(json) {
+		begin_json(q, "background");
+		append(q, ",\"pid\":%i}\n", pid);
+	} else {
+		append(q, "background pid is %i\n", pid);
+	}
+}
+
+/*Queues the message for a background process that has been reaped */
+void notify_done(pid_t pid, int childExitMethod) {
+	struct queue* q = event_queue();
+
+	if(WIFEXITED(childExitMethod) != 0) {
+		if(json) {
+			begin_json(q, "done");
+			append(q, ",\"pid\":%i,\"exit\":%i}\n", pid, WEXITSTATUS(childExitMethod));
+		} else {
+			append(q, "background pid %i is done: exit value %i\n", pid, WEXITSTATUS(childExitMethod));
+		}
+	} else {
+		if(json) {
+			begin_json(q, "done");
+			append(q, ",\"pid\":%i,\"signal\":%i}\n", pid, WTERMSIG(childExitMethod));
+		} else {
+			append(q, "background pid %i is done: terminated by signal %i\n", pid, WTERMSIG(childExitMethod));
+		}
+	}
+}
+
+/*Queues the message for a foreground process killed by a signal */
+void notify_terminated(int signo) {
+	struct queue* q = event_queue();
+
+	if(json) {
+		begin_json(q, "terminated");
+		append(q, ",\"signal\":%i}\n", signo);
+	} else {
+		append(q, "terminated by signal %i\n", signo);
+	}
+}
+
+/*Queues the message for the shell signalling a job that ran past its timeout.
+ * Call when the signal is sent */
+void notify_timeout(pid_t pid, long timeout_ms, int signo) {
+	struct queue* q = event_queue();
+
+	if(json) {
+		begin_json(q, "timeout");
+		append(q, ",\"pid\":%i,\"timeout_ms\":%ld,\"signal\":%i}\n", pid, timeout_ms, signo);
+	} else {
+		timeout_text(q, pid, timeout_ms, signo);
+	}
+}
+
+/*Queues the message for a job killed by one of its resource limits. Call when
+ * the job is reaped */
+void notify_limit(pid_t pid, int signo) {
+	struct queue* q = event_queue();
+
+	if(json) {
+		begin_json(q, "limit");
+		append(q, ",\"pid\":%i,\"signal\":%i}\n", pid, signo);
+	} else {
+		append(q, "limit: pid %i exceeded its CPU time limit\n", pid);
+	}
+}
+
+/*Queues the first line of the status builtin's output. value is an exit value
+ * if is_exit is 1, or a signal number otherwise */
+void notify_status(int value, int is_exit) {
+	if(is_exit == 1) {
+		append(&out, "exit value %i\n", value);
+	} else {
+		append(&out, "terminated by signal %i\n", value);
+	}
+}
+
+/*Queues a past timeout signal as a line of the status builtin's output */
+void notify_status_timeout(pid_t pid, long timeout_ms, int signo) {
+	timeout_text(&out, pid, timeout_ms, signo);
+}
+
+/*Queues a past resource limit kill as a line of the status builtin's output */
+void notify_status_limit(pid_t pid) {
+	append(&out, "limit: pid %i exceeded its CPU time limit\n", pid);
+}
+
+/*Writes every buffer in iov to fd, retrying after signals and short writes */
+static void write_all(int fd, struct iovec* iov, int count) {
+	ssize_t n;
+	int i;
+
+	while(count > 0) {
+		n = writev(fd, iov, count);
+		if(n < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return;
+		}
+
+		/*Skip past whatever was written, in case of a short write */
+		while(count > 0 && (size_t) n >= iov[0].iov_len) {
+			n -= iov[0].iov_len;
+			for(i = 1; i < count; i++) {
+				iov[i - 1] = iov[i];
+			}
+			count--;
+		}
+		if(count > 0) {
+			iov[0].iov_base = (char*) iov[0].iov_base + n;
+			iov[0].iov_len -= n;
+		}
+	}
+}
+
+/* Description: writes every queued message, followed by the prompt
+ * args: prompt: text to write after the messages, or NULL for none
+ * pre: none
+ * post: anything already in stdout's stdio buffer is flushed first, then the
+ * 	queued messages and the prompt go out in one writev(). If JSON lines have
+ * 	their own file descriptor, they are written there with one more writev().
+ * 	Both queues are empty afterwards
+ * ret: none
+ */
+void notify_flush(const char* prompt) {
+	struct iovec iov[3];
+	int count = 0;
+	int has_prompt = prompt != NULL && prompt[0] != '\0';
+
+	/*Keep the order with anything printed through stdio */
+	fflush(stdout);
+
+	if(events.used > 0) {
+		iov[0].iov_base = events.data;
+		iov[0].iov_len = events.used;
+		write_all(json_fd, iov, 1);
+		events.used = 0;
+	}
+
+	if(out.used > 0) {
+		/*Keep JSON objects off the line the last prompt is on */
+		if(json && json_fd == STDOUT_FILENO && after_prompt) {
+			iov[count].iov_base = "\n";
+			iov[count].iov_len = 1;
+			count++;
+		}
+		iov[count].iov_base = out.data;
+		iov[count].iov_len = out.used;
+		count++;
+	}
+	if(has_prompt) {
+		iov[count].iov_base = (char*) prompt;
+		iov[count].iov_len = strlen(prompt);
+		count++;
+	}
+
+	if(count > 0) {
+		write_all(STDOUT_FILENO, iov, count);
+		after_prompt = has_prompt;
+	}
+	out.used = 0;
+}
+
+/*Releases both queues */
+void notify_free() {
+	free(out.data);
+	free(events.data);
+	memset(&out, 0, sizeof(out));
+	memset(&events, 0, sizeof(events));
+}
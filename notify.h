@@ -0,0 +1,29 @@
+/* Filename: notify.h
+ * Author: Howard Chen
+ * Description: Interface for job and status notifications. Messages such as
+ * 	"background pid is N" are queued instead of printed, and the queue is
+ * 	written together with the next prompt in a single writev().
+ */
+
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <sys/types.h>
+
+void notify_set_json(int on);
+void notify_set_fd(int fd);
+
+void notify_background(pid_t pid);
+void notify_done(pid_t pid, int childExitMethod);
+void notify_terminated(int signo);
+void notify_timeout(pid_t pid, long timeout_ms, int signo);
+void notify_limit(pid_t pid, int signo);
+
+void notify_status(int value, int is_exit);
+void notify_status_timeout(pid_t pid, long timeout_ms, int signo);
+void notify_status_limit(pid_t pid);
+
+void notify_flush(const char* prompt);
+void notify_free();
+
+#endif
@@ -28,6 +28,11 @@
 #include <dirent.h>
 #include <signal.h>
 
+#include "vars.h"
+#include "joblimits.h"
+#include "trace.h"
+#include "notify.h"
+
 
 /**********          Program constants         ************* */
 #define EXIT 30       /*Return value that indicates shell should exit */
@@ -47,9 +52,19 @@ int is_exit = 1;  /*Indicates whether foreground_status is an exit value or term
 
 char pid[50]; /*Stores the PID of the shell */
 
+extern char** environ; /*Environment inherited from the parent of the shell */
+
 sig_atomic_t special; /*Global variable to hold whether special SIGTSP state has been entered 
  sig_atomic_t type was used for reentrancy*/
 
+/*Commands are read from stdin into this buffer instead of through stdio, so the
+ * shell knows whether a whole line is already waiting before it blocks for more */
+char* input = NULL;     /*Bytes read from stdin that have not been used yet */
+size_t input_start = 0; /*Start of the unused bytes */
+size_t input_end = 0;   /*End of the unused bytes */
+size_t input_size = 0;  /*Size of the buffer */
+int input_eof = 0;      /*Set when the last read found the end of stdin */
+
 
 /************  Function Prototypes   *************/
 /* See function implementations at end for function comments */
@@ -62,17 +77,25 @@ void parentSignalSetup();
 void foregroundSignalSetup();
 void backgroundSignalSetup();
 
+int inputHasLine();
+ssize_t fillInput();
+ssize_t takeLine(char** line, size_t* size);
 void getInput(char command[]);
 void getCommand(char command[]);
 
 int is_builtin(char* params[]);
 int cd(char* params[]);
 int status();
+int export(char* params[]);
+int unset(char* params[]);
+int trace(char* params[]);
 int exec_builtin(char* params[], int argc);
+int exec_builtin_assign(char* assigns[], int nassign, char* params[], int argc);
 void redirect_in_out(char* params[], int argc, int foreground);
 void clean(char* params[], int argc);
 int is_foreground(char* params[], int argc);
-int exec_non_builtin(char* params[], int argc);
+int exec_non_builtin(char* assigns[], int nassign, const struct job_limits* lim,
+		char* params[], int argc);
 int execute(char* params[], int argc);
 
 void cleanup();
@@ -86,6 +109,8 @@ int main() {
 	int ex;   /* exit flag */
 	char* params[MAX_ARG];  /* holds arguments */
 	char command[MAX_CHAR]; /* Holds user input command */
+	long fd;                /* File descriptor for JSON notifications */
+	char* end;
 	
 	/*Initially, not in special TSTP state */
 	special = 0;
@@ -96,6 +121,36 @@ int main() {
 	/*Get the process ID for use later*/
 	sprintf(pid, "%i", getpid());
 
+	/*Load the inherited environment into the shell variable table */
+	vars_init(environ);
+
+	/*Start tracing right away if asked to by the environment */
+	if(vars_get("SMALLSH_TRACE") != NULL && strcmp(vars_get("SMALLSH_TRACE"), "0") != 0) {
+		trace_enable(vars_get("SMALLSH_TRACE_FILE"));
+	}
+
+	/*Job and status messages can be JSON lines instead of text, for log collectors */
+	if(vars_get("SMALLSH_NOTIFY") != NULL && strcmp(vars_get("SMALLSH_NOTIFY"), "json") == 0) {
+		notify_set_json(1);
+
+		/*The JSON lines can go to a file descriptor opened by whoever started the shell */
+		if(vars_get("SMALLSH_NOTIFY_FD") != NULL) {
+			fd = strtol(vars_get("SMALLSH_NOTIFY_FD"), &end, 10);
+			if(*end != '\0' || end == vars_get("SMALLSH_NOTIFY_FD") || fd < 0
+					|| fcntl(fd, F_GETFD) == -1) {
+				fprintf(stderr, "SMALLSH_NOTIFY_FD: %s is not an open file descriptor\n",
+					vars_get("SMALLSH_NOTIFY_FD"));
+				fflush(stderr);
+			} else {
+				/*Jobs should not hold the log open */
+				if(fd > STDERR_FILENO) {
+					fcntl(fd, F_SETFD, FD_CLOEXEC);
+				}
+				notify_set_fd(fd);
+			}
+		}
+	}
+
 	/*get initial command*/
 	memset(command, '\0', sizeof(command));
 	getCommand(command);
@@ -116,7 +171,9 @@ int main() {
 		}
 		else if(argc < MAX_ARG - 2) {
 			/*Otherwise, if the argument list was not exceeded, execute the command */
+			TRACE_BEGIN(TR_EXECUTE);
 			ex = execute(params, argc);
+			TRACE_END(TR_EXECUTE);
 
 			/*If the exit flag was called, execute returns EXIT. So break out of the loop */
 			if (ex == EXIT) {
@@ -138,9 +195,19 @@ int main() {
 	} 
 
 
-	/*Before exiting the shell, kill all background processes */
+	/*Write out any messages still queued, then kill all background processes */
+	notify_flush(NULL);
 	kill_everything();
 
+	/*The shutdown is only in the trace if the buffer is written after it */
+	if(trace_enabled) {
+		trace_dump(NULL);
+	}
+	joblimits_free();
+	notify_free();
+	vars_free();
+	free(input);
+
 	return 0;
 }
 
@@ -157,6 +224,8 @@ void kill_everything() {
 	int exitStatus;
 	int signal;
 
+	TRACE_BEGIN(TR_KILL_EVERYTHING);
+
 	/*Send the terminate signal to all background processess 
  * 		of the shell*/
 	kill(0, SIGTERM);
@@ -183,6 +252,7 @@ void kill_everything() {
 	}
 	fflush(stdout);
 
+	TRACE_END(TR_KILL_EVERYTHING);
 	return;
 }
 
@@ -205,6 +275,16 @@ void catchSIGTSTP(int signo) {
 	
 }
 
+/*Signal handler for SIGUSR1. Dumps the trace buffer, if tracing was ever turned on,
+ * to the trace file. trace_dump() only uses async-signal-safe calls */
+void catchSIGUSR1(int signo) {
+	char* message = "\ntrace written\n";
+
+	if(trace_dump(NULL) >= 0) {
+		write(STDERR_FILENO, message, strlen(message));
+	}
+}
+
 /*Signal handler for SIGCHLD. Does nothing. I tried deleting and setting the parent process
  * to ignore SIGCHLD, but that caused bugs for some reason, so I've left this in even though
  * it really should be removed */
@@ -215,7 +295,7 @@ void catchSIGCHLD(int signo) {
 /* Description: sets up signal handling for the shell
  * Args: none
  * pre: none
- * post: Sets up SIGTSTP and SIGCHLD for their own special signal handling.
+ * post: Sets up SIGTSTP, SIGCHLD, and SIGUSR1 for their own special signal handling.
  * 	Sets up SIGINT and SIGTERM to be ignored by the shell process
  * ret: none
  *
@@ -227,6 +307,7 @@ void parentSignalSetup() {
 	struct sigaction IGNORE_action = {{0}};
 	struct sigaction SIGTSTP_action = {{0}};
 	struct sigaction SIGCHLD_action = {{0}};
+	struct sigaction SIGUSR1_action = {{0}};
 
 	/*Set up SIGTSTP handling */
 	SIGTSTP_action.sa_handler = catchSIGTSTP;
@@ -240,6 +321,12 @@ void parentSignalSetup() {
 	SIGCHLD_action.sa_flags = 0;
 	sigaction(SIGCHLD, &SIGCHLD_action, NULL);
 
+	/*Set up SIGUSR1 handling */
+	SIGUSR1_action.sa_handler = catchSIGUSR1;
+	sigfillset(&SIGUSR1_action.sa_mask);
+	SIGUSR1_action.sa_flags = 0;
+	sigaction(SIGUSR1, &SIGUSR1_action, NULL);
+
 	/*Set up ignore handling for SIGINT and SIGTERM*/
 	IGNORE_action.sa_handler = SIG_IGN;
 	sigaction(SIGINT, &IGNORE_action, NULL);
@@ -302,6 +389,84 @@ void backgroundSignalSetup() {
 }
 
 
+/*Returns 1 if the input buffer holds a whole line, 0 otherwise */
+int inputHasLine() {
+	return input != NULL && memchr(input + input_start, '\n', input_end - input_start) != NULL;
+}
+
+/* Description: reads more of stdin into the input buffer
+ * args: none
+ * pre: none
+ * post: unused bytes are moved to the start of the buffer, which grows if it is
+ * 	full, and then a single read() appends whatever stdin has ready
+ * ret: the number of bytes read, 0 at the end of stdin, or -1 if read() failed,
+ * 	such as when a signal interrupted it
+ */
+ssize_t fillInput() {
+	ssize_t n;
+
+	if(input_start > 0) {
+		memmove(input, input + input_start, input_end - input_start);
+		input_end -= input_start;
+		input_start = 0;
+	}
+	if(input_end == input_size) {
+		input_size = input_size == 0 ? MAX_CHAR : input_size * 2;
+		input = realloc(input, input_size);
+		if(input == NULL) {
+			perror("Failure to allocate input buffer"); fflush(stderr);
+			exit(1);
+		}
+	}
+
+	n = read(STDIN_FILENO, input + input_end, input_size - input_end);
+	if(n > 0) {
+		input_end += n;
+	} else if(n == 0) {
+		input_eof = 1;
+	}
+	return n;
+}
+
+/* Description: takes the next line out of the input buffer
+ * args: [1] line: heap buffer for the line, or NULL, as with getline()
+ * 	[2] size: size of *line
+ * pre: none
+ * post: *line holds the line and its newline, null terminated. At the end of
+ * 	stdin, a last line with no newline is taken as it is
+ * ret: the length of the line, or -1 if there is no whole line yet
+ */
+ssize_t takeLine(char** line, size_t* size) {
+	char* newline = NULL;
+	size_t length;
+
+	if(input != NULL) {
+		newline = memchr(input + input_start, '\n', input_end - input_start);
+	}
+	if(newline != NULL) {
+		length = newline - (input + input_start) + 1;
+	} else if(input_eof == 1 && input_end > input_start) {
+		length = input_end - input_start;
+	} else {
+		input_eof = 0;
+		return -1;
+	}
+	input_eof = 0;
+
+	if(*line == NULL || *size < length + 1) {
+		*size = length + 1;
+		*line = realloc(*line, *size);
+		if(*line == NULL) {
+			perror("Failure to allocate input line"); fflush(stderr);
+			exit(1);
+		}
+	}
+	memcpy(*line, input + input_start, length);
+	(*line)[length] = '\0';
+	input_start += length;
+	return length;
+}
+
 /* Description: gets user input from stdin
  * args: [1] command: a char array
  * pre: command should have at most MAX_CHAR - 3 elements available
@@ -316,22 +481,35 @@ void getInput(char command[]) {
 
 	int charsRead = 0;	
 	int current = 0;
-	int dollars = 0;
+	int length = 0;
+	int nameLength = 0;
+	const char* value;
+	char* end;
 	char c;
 
-	/*As described in the lecture notes, this method uses getline() to get user
+	TRACE_BEGIN(TR_GET_INPUT);
+
+	/*As described in the lecture notes, this method gets a line of user
  * 		input, but also recovers from any signals that interfere with
- * 		getline */
+ * 		reading it by printing the prompt again */
+	TRACE_BEGIN(TR_READ);
 	while(1) {
-		printf(": "); fflush(stdout);
-		numChars = getline(&lineEntered, &bufferSize, stdin);
-		if(numChars == -1) {
-			clearerr(stdin);
+		/*Queued job and status messages go out together with the prompt */
+		notify_flush(": ");
+		while(inputHasLine() == 0) {
+			/*If any job has a timeout, keep enforcing it while the shell sits at the prompt */
+			joblimits_wait_input(STDIN_FILENO);
+			if(fillInput() <= 0) {
+				break;
+			}
 		}
-		else {
+		numChars = takeLine(&lineEntered, &bufferSize);
+		if(numChars != -1) {
 			break; /*Exit the loop - we have input */
 		}
 	}
+	TRACE_END(TR_READ);
+	TRACE_BEGIN(TR_EXPAND);
 
 	/*remove trailing newline */
 	lineEntered[strcspn(lineEntered, "\n")] = '\0';
@@ -340,38 +518,69 @@ void getInput(char command[]) {
 	
 
 	/*For every character in the user input, copy it into the command array.
- * 	Anytime two dollar signs are encountered, expand the dollar signs into
- * 	the process ID */
+ * 	Expand $$ into the process ID, and $NAME or ${NAME} into the value of
+ * 	the shell variable NAME (empty if it is not set). A $ that does not start
+ * 	one of these forms is copied as is */
 	charsRead = 0;
 	current = 0;
+	length = strlen(lineEntered);
 		/*continue while there are still characters to read, and while
  * 			the buffer has not overflowed */
-	while(current < MAX_CHAR - 2 && charsRead < strlen(lineEntered) ) {
+	while(current < MAX_CHAR - 2 && charsRead < length) {
 		c = lineEntered[charsRead];
 		charsRead++;
 
-		/*If two dollar signs in a row, do the replacement*/
-		if( c == '$' && dollars == 1) {
-			strcpy(command + current - 1, pid);
-			dollars = 0;
-			current = strlen(command); 
+		if(c != '$') {
+			command[current] = c;
+			current++;
+			continue;
+		}
+
+		value = NULL;
+		if(lineEntered[charsRead] == '$') {
+			/*Two dollar signs in a row expand to the process ID */
+			value = pid;
+			charsRead++;
+		} else if(lineEntered[charsRead] == '{') {
+			/*${NAME}: the name runs up to the closing brace */
+			end = strchr(lineEntered + charsRead + 1, '}');
+			nameLength = end == NULL ? 0 : end - (lineEntered + charsRead + 1);
+			if(vars_valid_name(lineEntered + charsRead + 1, nameLength) == 1) {
+				value = vars_getn(lineEntered + charsRead + 1, nameLength);
+				value = value == NULL ? "" : value;
+				charsRead += nameLength + 2;
+			}
 		} else {
-		/*If first dollar sign, increment the dollar count*/
-		/*If not, set dollar count to 0 */
-		/*Either way, store the char*/
-			if(c == '$') {
-				dollars++;
-			} else {
-				dollars = 0;
+			/*$NAME: the name is the longest run of name characters */
+			nameLength = strspn(lineEntered + charsRead,
+				"abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_");
+			if(vars_valid_name(lineEntered + charsRead, nameLength) == 1) {
+				value = vars_getn(lineEntered + charsRead, nameLength);
+				value = value == NULL ? "" : value;
+				charsRead += nameLength;
 			}
+		}
+
+		if(value == NULL) {
+			/*Not an expansion, so keep the dollar sign */
 			command[current] = c;
 			current++;
+		} else {
+			/*Copy as much of the value as fits in the buffer */
+			while(*value != '\0' && current < MAX_CHAR - 2) {
+				command[current] = *value;
+				current++;
+				value++;
+			}
 		}
 	}
 
+	TRACE_END(TR_EXPAND);
+
 	/*Free the heap memory containing user input */
 	free(lineEntered);
 	
+	TRACE_END(TR_GET_INPUT);
 	return;
 }
 
@@ -389,10 +598,15 @@ void getCommand(char command[]) {
 /*Examines the first parameter and checks to see if it is in the list
  * of builtin commands. Returns 1 if it is, 0 otherwise */
 int is_builtin(char* params[]) {
-	char* builtin = " cd status exit ";
+	char* builtin = " cd status exit export unset trace ";
+	char token[MAX_CHAR + 2];
+
+	/*Surround the token with spaces so that only whole names match, and
+ * 		not pieces of names (for example "s" or "port") */
+	snprintf(token, sizeof(token), " %s ", params[0]);
 
 	/*if the token is not in the list of commands, return 0*/
-	if( strstr(builtin, params[0]) == NULL) {
+	if( strstr(builtin, token) == NULL) {
 		return 0;
 	} 
 
@@ -419,7 +633,11 @@ int cd(char* params[]) {
 	/*If no filepath, use HOME */
 	if(filepath == NULL) {
 		/*execute cd by checking the home directory*/
-		filepath = getenv("HOME");
+		filepath = (char*) vars_get("HOME");
+		if(filepath == NULL) {
+			fprintf(stderr, "cd: HOME not set\n"); fflush(stderr);
+			return 1;
+		}
 		status = chdir(filepath);
 	} else {
 		/*Otherwise, change directory to the specified filepath */
@@ -428,14 +646,111 @@ int cd(char* params[]) {
 	return status;
 }
 
-/*Simply prints out the value of the foreground_status global variable, based on whether
- * or not the is_exit flag is set. The return value is meaningless */
+/*Simply reports the value of the foreground_status global variable, based on whether
+ * or not the is_exit flag is set, followed by any limits or timeouts the shell has enforced.
+ * The messages are queued, and printed with the next prompt. The return value is meaningless */
 int status() {
-	if(is_exit == 1) {
-		fprintf(stdout, "exit value %i\n", foreground_status); fflush(stdout);
+	notify_status(foreground_status, is_exit);
+	joblimits_print();
+	return 0;
+}
+
+/* Description: marks shell variables as exported
+ * args: params, an array of char* that are parameters
+ * pre: params[0] is "export"
+ * post: each NAME=value parameter sets NAME and exports it. Each NAME parameter
+ * 	exports the existing variable NAME. With no parameters, every exported
+ * 	variable is printed
+ * ret: 0 on success, 1 if any parameter was not a valid name
+ */
+int export(char* params[]) {
+	int s = 0;
+	int current;
+	int result;
+
+	if(params[1] == NULL) {
+		vars_print_exported();
+		return 0;
 	}
-	else {
-		fprintf(stdout, "terminated by signal %i\n", foreground_status); fflush(stdout);
+
+	for(current = 1; params[current] != NULL; current++) {
+		if(strchr(params[current], '=') != NULL) {
+			result = vars_assign(params[current], 1);
+		} else {
+			result = vars_export(params[current]);
+		}
+		if(result != 0) {
+			fprintf(stderr, "export: %s: not a valid identifier\n", params[current]);
+			fflush(stderr);
+			s = 1;
+		}
+	}
+	return s;
+}
+
+/* Description: removes shell variables
+ * args: params, an array of char* that are parameters
+ * pre: params[0] is "unset"
+ * post: each named variable is removed, and removed from the environment of
+ * 	later child processes if it was exported
+ * ret: 0 on success, 1 if any parameter was not a valid name
+ */
+int unset(char* params[]) {
+	int s = 0;
+	int current;
+
+	for(current = 1; params[current] != NULL; current++) {
+		if(vars_unset(params[current]) != 0) {
+			fprintf(stderr, "unset: %s: not a valid identifier\n", params[current]);
+			fflush(stderr);
+			s = 1;
+		}
+	}
+	return s;
+}
+
+/* Description: controls hot path tracing
+ * args: params, an array of char* that are parameters
+ * pre: params[0] is "trace"
+ * post: "trace on [file]" starts recording events, and sets the file they are
+ * 	dumped to. "trace off" stops recording. "trace dump [file]" writes the
+ * 	recorded events in Chrome trace JSON format. With no parameters, prints
+ * 	whether tracing is on
+ * ret: 0 on success, 1 otherwise
+ */
+int trace(char* params[]) {
+	int count;
+
+	if(params[1] == NULL) {
+		printf("tracing is %s\n", trace_enabled ? "on" : "off"); fflush(stdout);
+
+	} else if(strcmp(params[1], "on") == 0) {
+		if(trace_enable(params[2]) != 0) {
+			perror("trace: cannot allocate trace buffer"); fflush(stderr);
+			return 1;
+		}
+
+	} else if(strcmp(params[1], "off") == 0) {
+		trace_disable();
+
+	} else if(strcmp(params[1], "dump") == 0) {
+		/*The trace path is only set once tracing has been turned on */
+		if(trace_path()[0] == '\0') {
+			fprintf(stderr, "trace: nothing recorded, use trace on first\n"); fflush(stderr);
+			return 1;
+		}
+		count = trace_dump(params[2]);
+		if(count < 0) {
+			fprintf(stderr, "trace: cannot write %s\n", params[2] != NULL ? params[2] : trace_path());
+			fflush(stderr);
+			return 1;
+		}
+		printf("%i trace events written to %s\n", count, params[2] != NULL ? params[2] : trace_path());
+		fflush(stdout);
+
+	} else {
+		fprintf(stderr, "trace: usage: trace [on [file] | off | dump [file]]\n"); fflush(stderr);
+		return 1;
 	}
 	return 0;
 }
@@ -444,7 +759,8 @@ int status() {
 /* Description: Executes the specified builtin command
  * args: [1] params: array of char* parameters
  * 	[2] argc: number of parameters
- * pre: params[0] must be a builtin command: either "cd", "status", or "exit"
+ * pre: params[0] must be a builtin command: "cd", "status", "export", "unset", "trace",
+ * 	or "exit"
  * post: the specified builtin command is executed
  * ret: the integer EXIT if the command was "exit"
  *	otherwies returns 0
@@ -464,6 +780,15 @@ int exec_builtin(char* params[], int argc) {
 	} else if (strcmp(name, "status") == 0) {
 		s = status();	
 
+	} else if (strcmp(name, "export") == 0) {
+		s = export(params);
+
+	} else if (strcmp(name, "unset") == 0) {
+		s = unset(params);
+
+	} else if (strcmp(name, "trace") == 0) {
+		s = trace(params);
+
 	} else {
 		/*otherwise exit*/
 		return EXIT;
@@ -472,6 +797,49 @@ int exec_builtin(char* params[], int argc) {
 	return 0;
 }
 
+/* Description: Executes a builtin command with NAME=value prefixes
+ * args: [1] assigns: array of NAME=value words that came before the command
+ * 	[2] nassign: number of words in assigns
+ * 	[3] params: array of char* parameters, starting with the builtin
+ * 	[4] argc: number of parameters
+ * pre: params[0] must be a builtin command
+ * post: the assignments are visible while the builtin runs, and every variable
+ * 	they touched is restored afterwards. The words in assigns are split at '='
+ * ret: the result of exec_builtin
+ */
+int exec_builtin_assign(char* assigns[], int nassign, char* params[], int argc) {
+	char* saved[MAX_ARG]; /*Old value of each assigned variable, or NULL if unset */
+	char* value;
+	const char* old;
+	int current;
+	int result;
+
+	/*Apply each assignment, remembering what it replaced */
+	for(current = 0; current < nassign; current++) {
+		value = strchr(assigns[current], '=');
+		*value = '\0';
+		value++;
+
+		old = vars_get(assigns[current]);
+		saved[current] = old == NULL ? NULL : strdup(old);
+		vars_set(assigns[current], value, 0);
+	}
+
+	result = exec_builtin(params, argc);
+
+	/*Restore in reverse order, so repeated names end with their first old value */
+	for(current = nassign - 1; current >= 0; current--) {
+		if(saved[current] == NULL) {
+			vars_unset(assigns[current]);
+		} else {
+			vars_set(assigns[current], saved[current], 0);
+			free(saved[current]);
+		}
+	}
+
+	return result;
+}
+
 /* Description: redirects input and output based on the parameters
  * args: [1] params: array of char*
  * 	[2] argc: number of params
@@ -566,28 +934,38 @@ int is_foreground(char* params[], int argc) {
 }
 
 /* Description: Executes non-builtin functions as child processes
- * args: [1] params: array of char* parameters
- * 	[2] argc: number of parameters
+ * args: [1] assigns: array of NAME=value words that came before the command
+ * 	[2] nassign: number of words in assigns
+ * 	[3] lim: resource limits and timeout from "limit" and "timeout" prefixes
+ * 	[4] params: array of char* parameters
+ * 	[5] argc: number of parameters
  * pre: argc > 1
  * post: appropriate signal handling will be set up for the child process,
  * 	whether foreground or background. If foreground, shell will wait
  * 	for child process and then update foreground_status and is_exit
  * 	global variables based on how the process termined 
- * 	print messages based on termination values
+ * 	queue messages based on termination values
  *
  * 	if background, do nothing in this function.
+ * 	the child process runs with every exported variable, plus the assignments
+ * 	in assigns, as its environment. the resource limits in lim are applied
+ * 	in the child, and the shell enforces its timeout whether it is foreground
+ * 	or background
  * ret: 0
  *
  *
  *
  */
-int exec_non_builtin(char* params[], int argc) {
+int exec_non_builtin(char* assigns[], int nassign, const struct job_limits* lim,
+		char* params[], int argc) {
 	/* This code models the code given in the processes lecture */
 	pid_t spawnpid = -5;
 	int state = -5;
 	int childExitMethod = -5;
 	int exitStatus = 0;
 	int signal = 0;
+	int current;
+	char** env;
 
 	int foreground;
 
@@ -599,6 +977,11 @@ int exec_non_builtin(char* params[], int argc) {
 		foreground = 1;
 	}
 	
+	/*Build the environment in the shell, so the cached array survives for the
+ * 		next spawn instead of being rebuilt in every child */
+	env = vars_environ();
+
+	TRACE_BEGIN(TR_FORK);
 	spawnpid = fork();
 	switch (spawnpid) {
 
@@ -608,6 +991,9 @@ int exec_non_builtin(char* params[], int argc) {
 			break;
 		case 0:
 			/*In child process: */
+			if(trace_enabled) {
+				trace_forked();
+			}
 			/*Set up signals based on foreground or background */
 			if(foreground == 1) {
 				foregroundSignalSetup();
@@ -619,7 +1005,26 @@ int exec_non_builtin(char* params[], int argc) {
 			/*Handle redirection and clean the arguments */
 			redirect_in_out(params, argc, foreground);
 			clean(params, argc);
+
+			/*Prefix assignments only affect this child, so apply them to the
+ * 				child's copy of the variable table and rebuild its environment.
+ * 				Without any, the shell's cached array is used as is */
+			if(nassign > 0) {
+				for(current = 0; current < nassign; current++) {
+					vars_assign(assigns[current], 1);
+				}
+				env = vars_environ();
+			}
+			environ = env;
+
+			/*Resource limits must be in place before the new program starts */
+			if(joblimits_apply(lim) != 0) {
+				perror("cannot set resource limit"); fflush(stderr);
+				exit(1);
+			}
 			
+			/*This lands in the shell's trace buffer, which is shared with children */
+			TRACE_MARK(TR_EXEC, getpid());
 			state = execvp(params[0], params);
 			printf("%s: no such file or directory\n", params[0]); fflush(stdout);	
 			/*If it returned, an error occurred, so terminate process */
@@ -630,10 +1035,16 @@ int exec_non_builtin(char* params[], int argc) {
 			/*Keep processing as the parent. Wait if it's a foreground */
 			/*Don't wait if it's a background */	
 
+			TRACE_END(TR_FORK);
+
+			/*Either way, track any timeout before the child can be reaped */
+			joblimits_watch(spawnpid, lim);
+
 			if(foreground == 1) {
-				while( waitpid(spawnpid, &childExitMethod, 0) != spawnpid) {
-					/*Keep waiting until it's over */
-				}
+				TRACE_BEGIN(TR_WAIT);
+				joblimits_wait(spawnpid, &childExitMethod);
+				TRACE_END(TR_WAIT);
+				joblimits_reaped(spawnpid, childExitMethod);
 				if(WIFEXITED(childExitMethod) != 0) {
 					/*Child did not exit by signal */
 					exitStatus = WEXITSTATUS(childExitMethod);
@@ -642,7 +1053,7 @@ int exec_non_builtin(char* params[], int argc) {
 					is_exit = 1;
 				} else if (WIFSIGNALED(childExitMethod) != 0) {
 					signal = WTERMSIG(childExitMethod);
-					printf("terminated by signal %i\n", signal); fflush(stdout);
+					notify_terminated(signal);
 					/*Update global status */
 					foreground_status = signal;
 					is_exit = 0;
@@ -654,7 +1065,7 @@ int exec_non_builtin(char* params[], int argc) {
 			} else {
 				/*If it's a background process, do nothing. */
 				/*Let signal handling and the cleanup function fix this */
-				printf("background pid is %i\n", spawnpid); fflush(stdout);
+				notify_background(spawnpid);
 
 			}
 			break;
@@ -665,15 +1076,49 @@ int exec_non_builtin(char* params[], int argc) {
 }
 
 /*Check if params specifies a builtin command or not. If so, execute it.
- * Otherwise execute a non-builtin command.
+ * Otherwise execute a non-builtin command. Leading NAME=value words are
+ * variable assignments: on their own they set shell variables, and before a
+ * command they only apply to that command. After the assignments, "limit" and
+ * "timeout" prefixes set resource limits and a deadline for a non-builtin command.
  *
  * Return the result of executing the builtin command, but just return 0 if
  * the non-builtin command is executed */
 int execute(char* params[], int argc) {
-	if ( is_builtin(params) == 1) {
-		return exec_builtin(params, argc);
+	int nassign = 0;
+	int nlimit = 0;
+	int current;
+	struct job_limits lim;
+
+	/*Count the leading assignments */
+	while(nassign < argc && vars_is_assignment(params[nassign]) == 1) {
+		nassign++;
+	}
+
+	/*Only assignments, so set them as shell variables */
+	if(nassign == argc) {
+		for(current = 0; current < nassign; current++) {
+			vars_assign(params[current], 0);
+		}
+		return 0;
+	}
+
+	/*Parse the limit and timeout prefixes that come after the assignments */
+	joblimits_clear(&lim);
+	nlimit = joblimits_parse(params + nassign, argc - nassign, &lim);
+	if(nlimit < 0) {
+		return 0;
+	}
+
+	if ( is_builtin(params + nassign + nlimit) == 1) {
+		/*Builtins run inside the shell, so there is no process to limit */
+		if(nlimit > 0) {
+			fprintf(stderr, "%s: cannot limit builtin %s\n", params[nassign], params[nassign + nlimit]);
+			fflush(stderr);
+			return 0;
+		}
+		return exec_builtin_assign(params, nassign, params + nassign, argc - nassign);
 	} else {
-		exec_non_builtin(params, argc);
+		exec_non_builtin(params, nassign, &lim, params + nassign + nlimit, argc - nassign - nlimit);
 	}
 	return 0;
 }
@@ -682,28 +1127,29 @@ int execute(char* params[], int argc) {
  * 		that are zombies that are discovred
  * args: none
  * pre: none
- * post: any zombie child processes will be cleaned up, and their pid and method of
- * 	termination will be printed to stdout
+ * post: timed jobs past their deadline are signalled.
+ * 	any zombie child processes will be cleaned up, and their pid and method of
+ * 	termination will be queued to print with the next prompt
  * ret: none
  */
 void cleanup() {
 	int childPID = 5;
 	int childExitMethod = 5;
-	int exitStatus;
-	int signal;
+
+	TRACE_BEGIN(TR_CLEANUP);
+
+	/*Signal any timed job whose deadline has passed */
+	joblimits_enforce();
 
 	/*Clean up every terminated background process that is currently available*/
 	childPID = waitpid(-1, &childExitMethod, WNOHANG);
 	while(childPID != 0 && childPID != -1) {
-		/*Get exit code or signal code, and print to console */	
-		if(WIFEXITED(childExitMethod) != 0) {
-			exitStatus = WEXITSTATUS(childExitMethod);
-			printf("background pid %i is done: exit value %i\n", childPID, exitStatus);
-			fflush(stdout);
-		} else if (WIFSIGNALED(childExitMethod) != 0) {
-			signal = WTERMSIG(childExitMethod);
-			printf("background pid %i is done: terminated by signal %i\n", childPID, signal);
-			fflush(stdout);
+		TRACE_MARK(TR_REAP, childPID);
+		joblimits_reaped(childPID, childExitMethod);
+
+		/*Queue a message with the exit code or signal code */	
+		if(WIFEXITED(childExitMethod) != 0 || WIFSIGNALED(childExitMethod) != 0) {
+			notify_done(childPID, childExitMethod);
 		} else {
 			perror("Failure to find child exit! \n"); fflush(stderr);
 			exit(1);
@@ -713,6 +1159,7 @@ void cleanup() {
 		childPID = waitpid(-1, &childExitMethod, WNOHANG);
 	}
 	fflush(stdout);
+	TRACE_END(TR_CLEANUP);
 	return;
 }
 
@@ -733,6 +1180,8 @@ int parse( char* params[], int max, char* command) {
 	char* word = NULL;
 	char* rest = command;
 
+	TRACE_BEGIN(TR_PARSE);
+
 	/*While there are more space-delimited parameters and the params array
  * 		has not overflowed, keep getting and storing parameters */
 	word = strtok_r(rest, " \t", &rest);
@@ -755,6 +1204,8 @@ int parse( char* params[], int max, char* command) {
 		params[count] = NULL;
 	}
 
+	TRACE_END(TR_PARSE);
+
 	/*Return the number of arguments */
 	return count;
 }
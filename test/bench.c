@@ -0,0 +1,440 @@
+/* Filename: bench.c
+ * Author: Howard Chen
+ * Description: Benchmark harness for smallsh.
+ *
+ * 	Runs ./smallsh on generated scripts to measure commands per second for
+ * 	builtin-only, fork-heavy, redirect-heavy and background-heavy workloads,
+ * 	the time the shell takes to exit (mostly kill_everything()), and its peak
+ * 	resident set size. It also calls parse() and getInput() directly, since
+ * 	smallsh.c is linked in with its main() renamed, to measure parse throughput.
+ *
+ * 	The results are compared against a stored baseline, and the run fails if
+ * 	any metric is worse than the baseline by more than the tolerance. It also
+ * 	fails if spawning commands keeps rebuilding the environment array.
+ *
+ * 	usage: bench SHELL BASELINE [--write]
+ * 		--write replaces the baseline with the results of this run
+ * 	BENCH_TOLERANCE sets the allowed fraction of slowdown (default 0.40)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "../vars.h"
+
+#define MAX_CHAR 4000  /*Same as smallsh.c */
+#define MAX_ARG 700    /*Same as smallsh.c */
+#define REPEAT 3       /*Each workload is run this many times and the fastest run is kept */
+#define MAX_METRICS 16
+#define MARKER "BENCH_DONE"
+
+/*From smallsh.c */
+int parse( char* params[], int max, char* command);
+void getInput(char command[]);
+int execute(char* params[], int argc);
+extern char pid[50];
+extern char** environ;
+
+struct metric {
+	const char* name;
+	double value;
+	const char* unit;
+	int higher_is_better;
+};
+
+struct run {
+	double work;     /*Seconds from starting the shell until the marker line */
+	double shutdown; /*Seconds from the marker line until the shell exits */
+	long rss;        /*Peak resident set size of the shell in KiB */
+};
+
+struct workload {
+	const char* name; /*Metric name */
+	const char* line; /*Command repeated to make the script */
+	int count;        /*Number of times the command is repeated */
+};
+
+static struct metric metrics[MAX_METRICS];
+static int num_metrics = 0;
+static char workdir[] = "/tmp/smallsh-bench-XXXXXX";
+
+
+static double now() {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_metric(const char* name, double value, const char* unit, int higher_is_better) {
+	metrics[num_metrics].name = name;
+	metrics[num_metrics].value = value;
+	metrics[num_metrics].unit = unit;
+	metrics[num_metrics].higher_is_better = higher_is_better;
+	num_metrics++;
+}
+
+/*Writes count copies of line to path. The script then prints the shell's peak
+ * memory and a marker line before it exits, so run_shell() can tell the time
+ * spent on the workload apart from the time spent shutting down */
+static void write_script(const char* path, const char* line, int count) {
+	FILE* f = fopen(path, "w");
+	int i;
+
+	if(f == NULL) {
+		perror(path);
+		exit(1);
+	}
+	for(i = 0; i < count; i++) {
+		fprintf(f, "%s\n", line);
+	}
+	fprintf(f, "grep VmHWM /proc/$$/status\n");
+	fprintf(f, "echo %s\n", MARKER);
+	fprintf(f, "exit\n");
+	fclose(f);
+}
+
+/* Description: runs the shell on a script inside the work directory
+ * args: [1] shell: path to smallsh
+ * 	[2] script: path to a script made by write_script()
+ * 	[3] result: filled in with the timings and peak memory of the run
+ * pre: none
+ * post: the shell has exited and been reaped. The program exits if the shell failed
+ * ret: none
+ */
+static void run_shell(const char* shell, const char* script, struct run* result) {
+	int childExitMethod;
+	int pipeFDs[2];
+	char* line = NULL;
+	size_t bufferSize = 0;
+	double start;
+	double marker = -1;
+	char* found;
+	pid_t child;
+	FILE* out;
+	int fd;
+
+	if(pipe(pipeFDs) != 0) {
+		perror("pipe");
+		exit(1);
+	}
+
+	start = now();
+	child = fork();
+	if(child == -1) {
+		perror("fork");
+		exit(1);
+	}
+
+	if(child == 0) {
+		/*kill_everything() signals the whole process group, so leave ours */
+		setpgid(0, 0);
+		if(chdir(workdir) != 0) {
+			exit(1);
+		}
+		fd = open(script, O_RDONLY);
+		dup2(fd, 0);
+		dup2(pipeFDs[1], 1);
+		fd = open("/dev/null", O_WRONLY);
+		dup2(fd, 2);
+		close(pipeFDs[0]);
+		close(pipeFDs[1]);
+		execl(shell, shell, (char*) NULL);
+		exit(127);
+	}
+
+	/*Read the shell's output until it closes, noting when the marker shows up */
+	close(pipeFDs[1]);
+	out = fdopen(pipeFDs[0], "r");
+	result->rss = 0;
+	while(getline(&line, &bufferSize, out) != -1) {
+		if(marker < 0 && strstr(line, MARKER) != NULL) {
+			marker = now();
+		}
+		found = strstr(line, "VmHWM:");
+		if(found != NULL) {
+			sscanf(found, "VmHWM: %ld", &result->rss);
+		}
+	}
+	fclose(out);
+	free(line);
+
+	waitpid(child, &childExitMethod, 0);
+	if(marker < 0 || !WIFEXITED(childExitMethod) || WEXITSTATUS(childExitMethod) != 0) {
+		fprintf(stderr, "%s failed on %s\n", shell, script);
+		exit(1);
+	}
+
+	result->work = marker - start;
+	result->shutdown = now() - marker;
+}
+
+/*Runs a script REPEAT times, and keeps the fastest times and the largest memory */
+static void best_run(const char* shell, const char* script, struct run* best) {
+	struct run r;
+	int i;
+
+	for(i = 0; i < REPEAT; i++) {
+		run_shell(shell, script, &r);
+		if(i == 0 || r.work < best->work) {
+			best->work = r.work;
+		}
+		if(i == 0 || r.shutdown < best->shutdown) {
+			best->shutdown = r.shutdown;
+		}
+		if(i == 0 || r.rss > best->rss) {
+			best->rss = r.rss;
+		}
+	}
+}
+
+/*Measures how many command lines per second parse() handles */
+static void bench_parse() {
+	const char* line = "wc -l -c < input.txt > output.txt extra args here &";
+	char command[MAX_CHAR];
+	char* params[MAX_ARG];
+	int iterations = 1000000;
+	double start;
+	int i;
+
+	start = now();
+	for(i = 0; i < iterations; i++) {
+		strcpy(command, line);
+		parse(params, MAX_ARG, command);
+	}
+	add_metric("parse_lines_per_sec", iterations / (now() - start), "lines/s", 1);
+}
+
+/*Measures how many lines per second getInput() reads and expands */
+static void bench_get_input() {
+	char path[64];
+	char command[MAX_CHAR];
+	int lines = 200000;
+	int saved_in, saved_out;
+	double start;
+	FILE* f;
+	int i;
+
+	sprintf(path, "%s/input", workdir);
+	f = fopen(path, "w");
+	for(i = 0; i < lines; i++) {
+		fprintf(f, "echo $$ $BENCH_VAR ${BENCH_VAR}x plain words %i\n", i);
+	}
+	fclose(f);
+
+	vars_set("BENCH_VAR", "value", 0);
+
+	/*Feed the file to stdin, and throw away the prompts */
+	fflush(stdout);
+	saved_in = dup(0);
+	saved_out = dup(1);
+	dup2(open(path, O_RDONLY), 0);
+	dup2(open("/dev/null", O_WRONLY), 1);
+
+	start = now();
+	for(i = 0; i < lines; i++) {
+		memset(command, '\0', sizeof(command));
+		getInput(command);
+	}
+	add_metric("getinput_lines_per_sec", lines / (now() - start), "lines/s", 1);
+
+	fflush(stdout);
+	dup2(saved_in, 0);
+	dup2(saved_out, 1);
+	close(saved_in);
+	close(saved_out);
+}
+
+/*Spawns commands through execute() and checks that the shell builds the
+ * environment array once and then reuses it. Returns 1 if not, 0 otherwise */
+static int check_env_cache() {
+	char word_true[] = "true";
+	char word_assign[] = "BENCH_ONLY=1";
+	char* params[3];
+	unsigned long before;
+	unsigned long after;
+	int spawns = 100;
+	int i;
+
+	/*Prefix assignments only rebuild the child's copy of the environment */
+	before = vars_environ_builds();
+	for(i = 0; i < spawns; i++) {
+		params[0] = (i % 2 == 0) ? word_true : word_assign;
+		params[1] = word_true;
+		params[2] = NULL;
+		execute(params, (i % 2 == 0) ? 1 : 2);
+	}
+	after = vars_environ_builds();
+
+	printf("environment rebuilt %lu time(s) over %i spawns\n", after - before, spawns);
+	/*The shell itself must hold the cache, or every child builds its own */
+	if(after == 0 || after - before > 1) {
+		printf("environment array is not reused across spawns\n");
+		return 1;
+	}
+	return 0;
+}
+
+/*Runs every shell workload, and records commands per second, exit latency and memory */
+static void bench_shell(const char* shell) {
+	struct workload workloads[] = {
+		{ "builtin_cmds_per_sec",    "cd .",                        100000 },
+		{ "fork_cmds_per_sec",       "true",                        2000 },
+		{ "redirect_cmds_per_sec",   "cat < input.txt > output.txt", 2000 },
+		{ "background_cmds_per_sec", "true &",                      2000 }
+	};
+	char script[64];
+	char input[64];
+	struct run empty, r;
+	double t;
+	long peak;
+	FILE* f;
+	int i;
+
+	sprintf(input, "%s/input.txt", workdir);
+	f = fopen(input, "w");
+	fprintf(f, "a small file for the redirect workload\n");
+	fclose(f);
+
+	/*An empty script measures startup and shutdown. Startup is taken out of the workloads */
+	sprintf(script, "%s/empty.sh", workdir);
+	write_script(script, "", 0);
+	best_run(shell, script, &empty);
+	add_metric("shutdown_ms", empty.shutdown * 1000, "ms", 0);
+	peak = empty.rss;
+
+	for(i = 0; i < (int) (sizeof(workloads) / sizeof(workloads[0])); i++) {
+		sprintf(script, "%s/workload.sh", workdir);
+		write_script(script, workloads[i].line, workloads[i].count);
+		best_run(shell, script, &r);
+		t = r.work - empty.work;
+		if(t <= 0) {
+			t = 1e-6;
+		}
+		add_metric(workloads[i].name, workloads[i].count / t, "cmds/s", 1);
+		if(r.rss > peak) {
+			peak = r.rss;
+		}
+	}
+
+	add_metric("peak_rss_kb", peak, "KiB", 0);
+}
+
+/*Compares the results to the baseline file. Returns the number of regressions */
+static int compare(const char* path, double tolerance) {
+	char name[128];
+	double base;
+	double change;
+	int found[MAX_METRICS] = { 0 };
+	int regressions = 0;
+	int worse;
+	FILE* f = fopen(path, "r");
+	int i;
+
+	if(f == NULL) {
+		printf("no baseline at %s, run \"make bench-baseline\" to record one\n", path);
+		return 0;
+	}
+
+	while(fscanf(f, "%127s %lf", name, &base) == 2) {
+		for(i = 0; i < num_metrics; i++) {
+			if(strcmp(metrics[i].name, name) != 0 || base <= 0) {
+				continue;
+			}
+			found[i] = 1;
+			change = (metrics[i].value - base) / base;
+			worse = metrics[i].higher_is_better ? change < -tolerance : change > tolerance;
+			printf("%-26s %14.1f %-8s baseline %14.1f  %+6.1f%%  %s\n", metrics[i].name,
+				metrics[i].value, metrics[i].unit, base, change * 100, worse ? "REGRESSION" : "ok");
+			regressions += worse;
+		}
+	}
+	fclose(f);
+
+	for(i = 0; i < num_metrics; i++) {
+		if(found[i] == 0) {
+			printf("%-26s %14.1f %-8s (not in baseline)\n", metrics[i].name, metrics[i].value, metrics[i].unit);
+		}
+	}
+	return regressions;
+}
+
+/*Writes the results as a new baseline */
+static void write_baseline(const char* path) {
+	FILE* f = fopen(path, "w");
+	int i;
+
+	if(f == NULL) {
+		perror(path);
+		exit(1);
+	}
+	for(i = 0; i < num_metrics; i++) {
+		fprintf(f, "%s %.1f\n", metrics[i].name, metrics[i].value);
+		printf("%-26s %14.1f %s\n", metrics[i].name, metrics[i].value, metrics[i].unit);
+	}
+	fclose(f);
+	printf("baseline written to %s\n", path);
+}
+
+int main(int argc, char* argv[]) {
+	double tolerance = 0.40;
+	int regressions;
+	int env_rebuilt;
+	char cleanup[64];
+	char* shell;
+
+	if(argc < 3) {
+		fprintf(stderr, "usage: %s SHELL BASELINE [--write]\n", argv[0]);
+		return 2;
+	}
+	if(getenv("BENCH_TOLERANCE") != NULL) {
+		tolerance = atof(getenv("BENCH_TOLERANCE"));
+	}
+	/*The shell runs inside the work directory, so it needs an absolute path */
+	shell = realpath(argv[1], NULL);
+	if(shell == NULL) {
+		perror(argv[1]);
+		return 1;
+	}
+	if(mkdtemp(workdir) == NULL) {
+		perror("mkdtemp");
+		return 1;
+	}
+
+	/*The shell functions expect the state main() would have set up */
+	sprintf(pid, "%i", getpid());
+	vars_init(environ);
+
+	bench_parse();
+	bench_get_input();
+	bench_shell(shell);
+	env_rebuilt = check_env_cache();
+
+	sprintf(cleanup, "rm -rf %s", workdir);
+	system(cleanup);
+
+	if(argc > 3 && strcmp(argv[3], "--write") == 0) {
+		write_baseline(argv[2]);
+		return 0;
+	}
+
+	regressions = compare(argv[2], tolerance);
+	if(env_rebuilt != 0) {
+		return 1;
+	}
+	if(regressions > 0) {
+		printf("%i metric(s) regressed by more than %.0f%%\n", regressions, tolerance * 100);
+		return 1;
+	}
+	printf("no regressions (tolerance %.0f%%)\n", tolerance * 100);
+	return 0;
+}
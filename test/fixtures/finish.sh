@@ -0,0 +1,7 @@
+# A background job that writes its pid to job.pid, then exits with $1 (or 0)
+# once wait_job.sh tells it to. It can never finish before the shell moves on
+echo $$ > job.tmp
+mv job.tmp job.pid
+while [ ! -e job.go ]; do sleep 0.01; done
+rm job.go
+exit ${1:-0}
@@ -0,0 +1,5 @@
+# A background job that never finishes on its own. It writes its pid to job.pid
+# for wait_job.sh, then becomes sleep so a signal reaches it directly
+echo $$ > job.tmp
+mv job.tmp job.pid
+exec sleep 30
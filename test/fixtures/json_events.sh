@@ -0,0 +1,9 @@
+# Checks that a timeout is logged once, when it happens, and that status only
+# answers on stdout
+SMALLSH_NOTIFY=json SMALLSH_NOTIFY_FD=3 "$SMALLSH" < json_events.txt 3> events.jsonl
+jq -r -s '[.[] | .event] as $names
+	| [.[] | select(.event == "timeout")] as $timeouts
+	| [.[] | select(.event == "background")] as $jobs
+	| "timeout events: \($timeouts | length)",
+	"logged after the deadline: \($timeouts[0].time - $jobs[0].time >= 0.99)",
+	"logged before the next job: \(($names | index("timeout")) < ($names | rindex("background")))"' events.jsonl
@@ -0,0 +1,8 @@
+# Runs json_jobs.txt with JSON notifications on their own file descriptor and
+# on stdout, and parses every JSON line of each. jq fails on a line that is not
+# exactly one JSON value
+SMALLSH_NOTIFY=json SMALLSH_NOTIFY_FD=3 "$SMALLSH" < json_jobs.txt > fd_out.txt 3> events.jsonl
+jq -c -R 'fromjson | .event' events.jsonl || echo "events.jsonl is not JSON lines"
+grep -c '{' fd_out.txt
+SMALLSH_NOTIFY=json "$SMALLSH" < json_jobs.txt > stdout_out.txt
+grep '{' stdout_out.txt | jq -c -R 'fromjson | .event' || echo "stdout has a broken JSON line"
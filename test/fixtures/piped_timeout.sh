@@ -0,0 +1,8 @@
+# Feeds a nested shell through a pipe, leaving it idle at the prompt until a
+# background job passes its timeout and exits
+{
+	echo "timeout 1 sh hang.sh &"
+	sh wait_job.sh
+	echo "status"
+	echo "exit"
+} | "$SMALLSH"
@@ -0,0 +1 @@
+while :; do :; done
@@ -0,0 +1,10 @@
+# Waits until the job that wrote job.pid has exited, telling finish.sh to go
+# first. An exited job stays a zombie until the shell reaps it, so this returns
+# before the shell notices. With an argument, it then sleeps that many seconds
+while [ ! -s job.pid ]; do sleep 0.01; done
+pid=$(cat job.pid)
+rm job.pid
+touch job.go
+while [ -e /proc/$pid ] && [ "$(cut -d' ' -f3 /proc/$pid/stat 2>/dev/null)" != Z ]; do sleep 0.01; done
+rm -f job.go
+[ -z "$1" ] || sleep "$1"
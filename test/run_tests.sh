@@ -0,0 +1,68 @@
+#!/bin/bash
+# Regression tests for smallsh.
+#
+# Each test/cases/NAME.in is fed to ./smallsh on stdin, in a fresh temporary
+# directory holding a copy of test/fixtures. The combined stdout and stderr is
+# compared against test/cases/NAME.out after replacing the shell's pid with PID,
+# other pids with N, JSON timestamps with T, and the temporary directory with TMP.
+# $SMALLSH holds the path of the shell, so a case can start a nested shell.
+# Cases wait on background jobs with fixtures/wait_job.sh, which watches for the
+# job started by finish.sh or hang.sh to exit, instead of sleeping a fixed time.
+#
+# Usage: test/run_tests.sh [NAME ...]
+#   UPDATE=1 rewrites the .out files from the current output instead of comparing.
+
+# Job control puts every shell under test in its own process group, since
+# kill_everything() sends SIGTERM to the whole group on exit
+set -m
+
+here=$(cd "$(dirname "$0")" && pwd)
+shell="$here/../smallsh"
+limit=60 # seconds before a hung test is killed
+
+if [ $# -gt 0 ]; then
+	names="$*"
+else
+	names=$(cd "$here/cases" && ls *.in | sed 's/\.in$//')
+fi
+
+pass=0
+fail=0
+for name in $names; do
+	input="$here/cases/$name.in"
+	expected="$here/cases/$name.out"
+	tmp=$(mktemp -d)
+	cp -r "$here/fixtures/." "$tmp"
+
+	(cd "$tmp" && HOME="$tmp" SMALLSH="$shell" exec "$shell" < "$input" > "$tmp/.output" 2>&1) &
+	pid=$!
+	(sleep $limit; kill -9 $pid) > /dev/null 2>&1 &
+	watchdog=$!
+	wait $pid
+	kill -- -$watchdog 2>/dev/null
+	wait $watchdog 2>/dev/null
+
+	# The shell's pid only matches a whole number, or a run of copies of it such
+	# as $$$$, so it is never taken out of the middle of another number
+	sed -e 's/"time":[0-9.]*/"time":T/g' -e 's/"pid":[0-9]*/"pid":N/g' \
+		-e ':pid' -e "s/\(^\|[^0-9]\)$pid\(\($pid\)*\)\([^0-9]\|\$\)/\1PID\2\4/" -e 't pid' \
+		-e 's/pid \(is \)*[0-9][0-9]*/pid \1N/g' -e "s|$tmp|TMP|g" "$tmp/.output" > "$tmp/.actual"
+
+	if [ "$UPDATE" = "1" ]; then
+		cp "$tmp/.actual" "$expected"
+		echo "updated $name"
+	elif diff -u "$expected" "$tmp/.actual" > "$tmp/.diff" 2>&1; then
+		echo "PASS $name"
+		pass=$((pass + 1))
+	else
+		echo "FAIL $name"
+		cat "$tmp/.diff"
+		fail=$((fail + 1))
+	fi
+	rm -rf "$tmp"
+done
+
+if [ "$UPDATE" != "1" ]; then
+	echo "$pass passed, $fail failed"
+fi
+[ $fail -eq 0 ]
@@ -0,0 +1,285 @@
+/* Filename: trace.c
+ * Author: Howard Chen
+ * Description: Implements the trace ring buffer.
+ *
+ * 	The ring lives in a shared anonymous mapping, so forked children can record
+ * 	events (such as the moment before execvp()) into the same buffer as the shell.
+ * 	Writers claim a slot with an atomic increment of the head and publish it by
+ * 	storing its sequence number last, so no locks are needed and a reader can
+ * 	skip slots that are half written. When the ring is full the oldest events
+ * 	are overwritten.
+ *
+ * 	trace_dump() only uses async-signal-safe calls, so the SIGUSR1 handler can
+ * 	dump the buffer in the middle of anything the shell is doing.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "trace.h"
+
+#define TRACE_SLOTS 16384 /*Size of the ring. Must be a power of two */
+#define MAX_PATH 1024
+
+struct trace_slot {
+	atomic_ulong seq;        /*Index + 1 of the event in this slot, 0 while it is written */
+	unsigned long long ts;   /*Monotonic time in nanoseconds */
+	long arg;                /*Event argument, such as a pid */
+	int tid;                 /*Process that recorded the event */
+	short event;
+	char phase;              /*'B' begin, 'E' end, or 'i' instant, as in Chrome traces */
+};
+
+struct trace_ring {
+	atomic_ulong head; /*Index of the next event to record */
+	struct trace_slot slots[TRACE_SLOTS];
+};
+
+volatile int trace_enabled = 0;
+
+static struct trace_ring* ring = NULL;
+static char dump_path[2 * MAX_PATH + 32]; /*Room for the working directory plus a file name */
+static int shell_pid;
+static int current_pid; /*Process recording events, kept here since getpid() is a system call */
+
+static const char* names[TR_NUM_EVENTS] = {
+	"getInput",
+	"read",
+	"expand",
+	"parse",
+	"execute",
+	"fork",
+	"exec",
+	"wait",
+	"cleanup",
+	"reap",
+	"kill_everything"
+};
+
+
+/* Description: turns tracing on
+ * args: path: file that trace_dump() writes to by default, or NULL to use
+ * 	smallsh-trace-PID.json in the current directory
+ * pre: none
+ * post: the ring buffer is allocated the first time, and events are recorded
+ * 	from now on. A relative path is made absolute, so cd does not move the dump
+ * ret: 0 on success, -1 if the ring buffer could not be allocated
+ */
+int trace_enable(const char* path) {
+	char cwd[MAX_PATH];
+
+	shell_pid = getpid();
+	current_pid = shell_pid;
+
+	if(ring == NULL) {
+		ring = mmap(NULL, sizeof(struct trace_ring), PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+		if(ring == MAP_FAILED) {
+			ring = NULL;
+			return -1;
+		}
+		atomic_init(&ring->head, 0);
+	}
+
+	if(getcwd(cwd, sizeof(cwd)) == NULL) {
+		strcpy(cwd, ".");
+	}
+	if(path == NULL) {
+		snprintf(dump_path, sizeof(dump_path), "%s/smallsh-trace-%i.json", cwd, shell_pid);
+	} else if(path[0] == '/') {
+		snprintf(dump_path, sizeof(dump_path), "%s", path);
+	} else {
+		snprintf(dump_path, sizeof(dump_path), "%s/%s", cwd, path);
+	}
+
+	trace_enabled = 1;
+	return 0;
+}
+
+/*Stops recording events. The buffer is kept, so it can still be dumped */
+void trace_disable() {
+	trace_enabled = 0;
+}
+
+/*Returns the file trace_dump() writes to by default */
+const char* trace_path() {
+	return dump_path;
+}
+
+/*Notes the pid of a newly forked child, so its events are told apart from the
+ * shell's. Call in the child right after fork() */
+void trace_forked() {
+	current_pid = getpid();
+}
+
+/*Records one event. Call through the TRACE_ macros, which skip this while tracing is off */
+void trace_record(enum trace_event event, char phase, long arg) {
+	struct trace_slot* slot;
+	struct timespec ts;
+	unsigned long index;
+
+	if(ring == NULL) {
+		return;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	index = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+	slot = &ring->slots[index & (TRACE_SLOTS - 1)];
+
+	/*Mark the slot as being written before changing it */
+	atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+
+	slot->ts = (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	slot->arg = arg;
+	slot->tid = current_pid;
+	slot->event = event;
+	slot->phase = phase;
+
+	/*Publish the slot */
+	atomic_store_explicit(&slot->seq, index + 1, memory_order_release);
+}
+
+
+/*A small output buffer for trace_dump(), which cannot use stdio */
+struct writer {
+	int fd;
+	int used;
+	char buf[4096];
+};
+
+static void flush_writer(struct writer* w) {
+	int done = 0;
+	int n;
+
+	while(done < w->used) {
+		n = write(w->fd, w->buf + done, w->used - done);
+		if(n <= 0) {
+			break;
+		}
+		done += n;
+	}
+	w->used = 0;
+}
+
+static void put_char(struct writer* w, char c) {
+	if(w->used == sizeof(w->buf)) {
+		flush_writer(w);
+	}
+	w->buf[w->used] = c;
+	w->used++;
+}
+
+static void put_str(struct writer* w, const char* s) {
+	while(*s != '\0') {
+		put_char(w, *s);
+		s++;
+	}
+}
+
+/*Writes a non-negative number, padded with zeros to at least width digits */
+static void put_num(struct writer* w, unsigned long long n, int width) {
+	char digits[24];
+	int i = sizeof(digits) - 1;
+
+	digits[i] = '\0';
+	do {
+		i--;
+		digits[i] = '0' + n % 10;
+		n /= 10;
+		width--;
+	} while(n > 0 || width > 0);
+	put_str(w, digits + i);
+}
+
+/* Description: writes the ring buffer to a file in Chrome trace JSON format
+ * args: path: file to write, or NULL for the path given to trace_enable()
+ * pre: none
+ * post: the file holds every complete event still in the ring, oldest first.
+ * 	Timestamps are in microseconds. Each process that recorded events shows up
+ * 	as its own thread
+ * ret: the number of events written, or -1 if there is no buffer or the file
+ * 	could not be opened
+ *
+ * Only async-signal-safe calls are used, so this can run inside a signal handler.
+ */
+int trace_dump(const char* path) {
+	struct writer w;
+	struct trace_slot copy;
+	struct trace_slot* slot;
+	unsigned long head;
+	unsigned long first;
+	unsigned long i;
+	int count = 0;
+
+	if(ring == NULL) {
+		return -1;
+	}
+	if(path == NULL) {
+		path = dump_path;
+	}
+
+	w.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if(w.fd < 0) {
+		return -1;
+	}
+	w.used = 0;
+
+	head = atomic_load_explicit(&ring->head, memory_order_acquire);
+	first = head > TRACE_SLOTS ? head - TRACE_SLOTS : 0;
+
+	put_str(&w, "{\"traceEvents\":[");
+	for(i = first; i < head; i++) {
+		slot = &ring->slots[i & (TRACE_SLOTS - 1)];
+
+		/*Copy the slot, then make sure it was not rewritten while copying */
+		if(atomic_load_explicit(&slot->seq, memory_order_acquire) != i + 1) {
+			continue;
+		}
+		copy.ts = slot->ts;
+		copy.arg = slot->arg;
+		copy.tid = slot->tid;
+		copy.event = slot->event;
+		copy.phase = slot->phase;
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&slot->seq, memory_order_relaxed) != i + 1
+				|| copy.event < 0 || copy.event >= TR_NUM_EVENTS) {
+			continue;
+		}
+
+		put_str(&w, count == 0 ? "\n" : ",\n");
+		put_str(&w, "{\"name\":\"");
+		put_str(&w, names[copy.event]);
+		put_str(&w, "\",\"cat\":\"smallsh\",\"ph\":\"");
+		put_char(&w, copy.phase);
+		put_str(&w, "\",\"ts\":");
+		put_num(&w, copy.ts / 1000, 1);
+		put_str(&w, ".");
+		put_num(&w, copy.ts % 1000, 3);
+		put_str(&w, ",\"pid\":");
+		put_num(&w, shell_pid, 1);
+		put_str(&w, ",\"tid\":");
+		put_num(&w, copy.tid, 1);
+		if(copy.phase == 'i') {
+			put_str(&w, ",\"s\":\"t\",\"args\":{\"pid\":");
+			put_num(&w, copy.arg, 1);
+			put_str(&w, "}");
+		}
+		put_str(&w, "}");
+		count++;
+	}
+	put_str(&w, "\n]}\n");
+
+	flush_writer(&w);
+	close(w.fd);
+	return count;
+}
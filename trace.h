@@ -0,0 +1,49 @@
+/* Filename: trace.h
+ * Author: Howard Chen
+ * Description: Interface for hot path tracing. Trace points record timestamped
+ * 	events into an in-memory ring buffer, which can be dumped in Chrome trace
+ * 	JSON format (load it in chrome://tracing or Perfetto).
+ *
+ * 	The TRACE_ macros only test a global flag while tracing is off. Build with
+ * 	-DNO_TRACE to remove them entirely.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*Every trace point. Keep in sync with the names in trace.c */
+enum trace_event {
+	TR_GET_INPUT,
+	TR_READ,
+	TR_EXPAND,
+	TR_PARSE,
+	TR_EXECUTE,
+	TR_FORK,
+	TR_EXEC,
+	TR_WAIT,
+	TR_CLEANUP,
+	TR_REAP,
+	TR_KILL_EVERYTHING,
+	TR_NUM_EVENTS
+};
+
+extern volatile int trace_enabled;
+
+#ifdef NO_TRACE
+#define TRACE_BEGIN(ev) do { } while(0)
+#define TRACE_END(ev) do { } while(0)
+#define TRACE_MARK(ev, arg) do { } while(0)
+#else
+#define TRACE_BEGIN(ev) do { if(trace_enabled) trace_record((ev), 'B', 0); } while(0)
+#define TRACE_END(ev) do { if(trace_enabled) trace_record((ev), 'E', 0); } while(0)
+#define TRACE_MARK(ev, arg) do { if(trace_enabled) trace_record((ev), 'i', (arg)); } while(0)
+#endif
+
+int trace_enable(const char* path);
+void trace_disable();
+void trace_forked();
+void trace_record(enum trace_event event, char phase, long arg);
+int trace_dump(const char* path);
+const char* trace_path();
+
+#endif
@@ -0,0 +1,371 @@
+/* Filename: vars.c
+ * Author: Howard Chen
+ * Description: Implements the shell variable table used for $VAR expansion,
+ * 	export, unset, and VAR=val command prefixes.
+ *
+ * 	Each variable is stored as a single "NAME=value" string, so the environment
+ * 	array handed to execvp() is just an array of pointers into the table. That
+ * 	array is only rebuilt when an exported variable changes, not on every spawn.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "vars.h"
+
+#define INITIAL_BUCKETS 64 /*Starting size of the hash table. Always a power of two */
+
+struct var {
+	char* entry;      /*"NAME=value", allocated on the heap */
+	size_t namelen;   /*Length of NAME, so the value starts at entry + namelen + 1 */
+	int exported;     /*1 if the variable is passed to child processes */
+	struct var* next; /*Next variable in the same bucket */
+};
+
+static struct var** buckets = NULL;
+static size_t num_buckets = 0;
+static size_t num_vars = 0;
+static size_t num_exported = 0;
+
+static char** env_cache = NULL; /*Cached environment array for child processes */
+static int env_dirty = 1;       /*Set whenever an exported variable changes */
+static unsigned long env_builds = 0; /*Number of times the environment array was rebuilt */
+
+
+/*FNV-1a hash over the first len characters of name */
+static size_t hash(const char* name, size_t len) {
+	size_t h = 2166136261u;
+	size_t i;
+
+	for(i = 0; i < len; i++) {
+		h ^= (unsigned char) name[i];
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/*Returns the variable with the given name, or NULL if there is none. If prev is not
+ * NULL, it is set to the variable before the match in the bucket (NULL if the match
+ * is at the head) */
+static struct var* lookup(const char* name, size_t len, struct var** prev) {
+	struct var* v;
+	struct var* before = NULL;
+
+	if(buckets == NULL) {
+		return NULL;
+	}
+
+	for(v = buckets[hash(name, len) & (num_buckets - 1)]; v != NULL; v = v->next) {
+		if(v->namelen == len && strncmp(v->entry, name, len) == 0) {
+			if(prev != NULL) {
+				*prev = before;
+			}
+			return v;
+		}
+		before = v;
+	}
+	return NULL;
+}
+
+/*Doubles the number of buckets and rehashes every variable into the new table */
+static void grow() {
+	size_t new_size = num_buckets == 0 ? INITIAL_BUCKETS : num_buckets * 2;
+	struct var** new_buckets = calloc(new_size, sizeof(struct var*));
+	struct var* v;
+	struct var* next;
+	size_t i, b;
+
+	if(new_buckets == NULL) {
+		perror("Failure to allocate variable table"); fflush(stderr);
+		exit(1);
+	}
+
+	for(i = 0; i < num_buckets; i++) {
+		for(v = buckets[i]; v != NULL; v = next) {
+			next = v->next;
+			b = hash(v->entry, v->namelen) & (new_size - 1);
+			v->next = new_buckets[b];
+			new_buckets[b] = v;
+		}
+	}
+
+	free(buckets);
+	buckets = new_buckets;
+	num_buckets = new_size;
+}
+
+/*Builds a new "NAME=value" string on the heap */
+static char* make_entry(const char* name, size_t len, const char* value) {
+	size_t vlen = strlen(value);
+	char* entry = malloc(len + vlen + 2);
+
+	if(entry == NULL) {
+		perror("Failure to allocate variable"); fflush(stderr);
+		exit(1);
+	}
+	memcpy(entry, name, len);
+	entry[len] = '=';
+	memcpy(entry + len + 1, value, vlen + 1);
+	return entry;
+}
+
+/* Description: sets a variable, given the name as a pointer and length
+ * pre: name[0..len) is a valid variable name
+ * post: the variable holds value. If exported is 1, the variable is marked as exported.
+ * 	If exported is 0, a new variable is not exported and an existing variable keeps
+ * 	its current export flag
+ * ret: 0 on success
+ */
+static int setn(const char* name, size_t len, const char* value, int exported) {
+	struct var* v = lookup(name, len, NULL);
+	size_t b;
+
+	if(v != NULL) {
+		free(v->entry);
+		v->entry = make_entry(name, len, value);
+		if(exported == 1 && v->exported == 0) {
+			v->exported = 1;
+			num_exported++;
+		}
+		if(v->exported == 1) {
+			env_dirty = 1;
+		}
+		return 0;
+	}
+
+	/*Keep the load factor under 3/4 */
+	if((num_vars + 1) * 4 > num_buckets * 3) {
+		grow();
+	}
+
+	v = malloc(sizeof(struct var));
+	if(v == NULL) {
+		perror("Failure to allocate variable"); fflush(stderr);
+		exit(1);
+	}
+	v->entry = make_entry(name, len, value);
+	v->namelen = len;
+	v->exported = exported;
+
+	b = hash(name, len) & (num_buckets - 1);
+	v->next = buckets[b];
+	buckets[b] = v;
+
+	num_vars++;
+	if(exported == 1) {
+		num_exported++;
+		env_dirty = 1;
+	}
+	return 0;
+}
+
+/*Loads every entry of envp into the table as an exported variable */
+void vars_init(char** envp) {
+	char* eq;
+
+	if(buckets == NULL) {
+		grow();
+	}
+
+	for(; envp != NULL && *envp != NULL; envp++) {
+		eq = strchr(*envp, '=');
+		if(eq != NULL && vars_valid_name(*envp, eq - *envp) == 1) {
+			setn(*envp, eq - *envp, eq + 1, 1);
+		}
+	}
+}
+
+/*Releases every variable and the cached environment array */
+void vars_free() {
+	struct var* v;
+	struct var* next;
+	size_t i;
+
+	for(i = 0; i < num_buckets; i++) {
+		for(v = buckets[i]; v != NULL; v = next) {
+			next = v->next;
+			free(v->entry);
+			free(v);
+		}
+	}
+	free(buckets);
+	free(env_cache);
+
+	buckets = NULL;
+	env_cache = NULL;
+	num_buckets = num_vars = num_exported = 0;
+	env_dirty = 1;
+}
+
+/*Returns 1 if name[0..len) is a legal variable name: a letter or underscore
+ * followed by letters, digits and underscores. Returns 0 otherwise */
+int vars_valid_name(const char* name, size_t len) {
+	size_t i;
+
+	if(len == 0 || !(isalpha((unsigned char) name[0]) || name[0] == '_')) {
+		return 0;
+	}
+	for(i = 1; i < len; i++) {
+		if(!(isalnum((unsigned char) name[i]) || name[i] == '_')) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/*Returns 1 if word has the form NAME=value, 0 otherwise */
+int vars_is_assignment(const char* word) {
+	const char* eq = strchr(word, '=');
+
+	if(eq == NULL) {
+		return 0;
+	}
+	return vars_valid_name(word, eq - word);
+}
+
+/*Returns the value of the named variable, or NULL if it is not set */
+const char* vars_get(const char* name) {
+	return vars_getn(name, strlen(name));
+}
+
+/*Same as vars_get, but the name is given as a pointer and a length, so it does not
+ * need to be null terminated */
+const char* vars_getn(const char* name, size_t len) {
+	struct var* v = lookup(name, len, NULL);
+
+	if(v == NULL) {
+		return NULL;
+	}
+	return v->entry + v->namelen + 1;
+}
+
+/*Sets the named variable. See setn() for how the exported flag is handled.
+ * Returns 0 on success, -1 if the name is not a legal variable name */
+int vars_set(const char* name, const char* value, int exported) {
+	size_t len = strlen(name);
+
+	if(vars_valid_name(name, len) == 0) {
+		return -1;
+	}
+	return setn(name, len, value, exported);
+}
+
+/*Sets a variable from a word of the form NAME=value.
+ * Returns 0 on success, -1 if the word is not an assignment */
+int vars_assign(const char* word, int exported) {
+	const char* eq = strchr(word, '=');
+
+	if(eq == NULL || vars_valid_name(word, eq - word) == 0) {
+		return -1;
+	}
+	return setn(word, eq - word, eq + 1, exported);
+}
+
+/*Marks the named variable as exported, creating it with an empty value if it
+ * does not exist yet. Returns 0 on success, -1 if the name is not legal */
+int vars_export(const char* name) {
+	struct var* v;
+	size_t len = strlen(name);
+
+	if(vars_valid_name(name, len) == 0) {
+		return -1;
+	}
+
+	v = lookup(name, len, NULL);
+	if(v == NULL) {
+		return setn(name, len, "", 1);
+	}
+	if(v->exported == 0) {
+		v->exported = 1;
+		num_exported++;
+		env_dirty = 1;
+	}
+	return 0;
+}
+
+/*Removes the named variable. Returns 0 whether or not the variable existed,
+ * -1 if the name is not legal */
+int vars_unset(const char* name) {
+	struct var* v;
+	struct var* prev = NULL;
+	size_t len = strlen(name);
+
+	if(vars_valid_name(name, len) == 0) {
+		return -1;
+	}
+
+	v = lookup(name, len, &prev);
+	if(v == NULL) {
+		return 0;
+	}
+
+	if(prev == NULL) {
+		buckets[hash(name, len) & (num_buckets - 1)] = v->next;
+	} else {
+		prev->next = v->next;
+	}
+
+	if(v->exported == 1) {
+		num_exported--;
+		env_dirty = 1;
+	}
+	num_vars--;
+	free(v->entry);
+	free(v);
+	return 0;
+}
+
+/* Description: returns a null terminated environment array holding every
+ * 	exported variable, suitable for assigning to environ before execvp()
+ * pre: none
+ * post: the array is rebuilt only if an exported variable changed since the last call
+ * ret: the environment array. It stays valid until the next change to an exported variable
+ */
+char** vars_environ() {
+	struct var* v;
+	size_t i, n;
+
+	if(env_dirty == 0 && env_cache != NULL) {
+		return env_cache;
+	}
+
+	free(env_cache);
+	env_cache = malloc((num_exported + 1) * sizeof(char*));
+	if(env_cache == NULL) {
+		perror("Failure to allocate environment"); fflush(stderr);
+		exit(1);
+	}
+
+	n = 0;
+	for(i = 0; i < num_buckets; i++) {
+		for(v = buckets[i]; v != NULL; v = v->next) {
+			if(v->exported == 1) {
+				env_cache[n] = v->entry;
+				n++;
+			}
+		}
+	}
+	env_cache[n] = NULL;
+
+	env_dirty = 0;
+	env_builds++;
+	return env_cache;
+}
+
+/*Returns how many times vars_environ() has rebuilt the environment array, so
+ * callers can check that the cache is reused across spawns */
+unsigned long vars_environ_builds() {
+	return env_builds;
+}
+
+/*Prints every exported variable to stdout, one NAME=value per line */
+void vars_print_exported() {
+	char** env;
+
+	for(env = vars_environ(); *env != NULL; env++) {
+		printf("%s\n", *env);
+	}
+	fflush(stdout);
+}
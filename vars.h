@@ -0,0 +1,28 @@
+/* Filename: vars.h
+ * Author: Howard Chen
+ * Description: Interface for the shell variable table. Shell variables live in a
+ * 	hash table keyed by name. Variables marked as exported are passed to child
+ * 	processes through the array returned by vars_environ().
+ */
+
+#ifndef VARS_H
+#define VARS_H
+
+void vars_init(char** envp);
+void vars_free();
+
+int vars_valid_name(const char* name, size_t len);
+int vars_is_assignment(const char* word);
+
+const char* vars_get(const char* name);
+const char* vars_getn(const char* name, size_t len);
+int vars_set(const char* name, const char* value, int exported);
+int vars_assign(const char* word, int exported);
+int vars_export(const char* name);
+int vars_unset(const char* name);
+
+char** vars_environ();
+unsigned long vars_environ_builds();
+void vars_print_exported();
+
+#endif